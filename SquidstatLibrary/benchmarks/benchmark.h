@@ -0,0 +1,296 @@
+/**
+ * A small benchmark harness in the style of Google Benchmark, so the benchmarks build with nothing but the API bundle.
+ *
+ * A benchmark is a function that repeats the measured work while BenchmarkState::keepRunning() is true. The runner
+ * increases the number of iterations until a run takes long enough to time, and reports the wall clock time and the CPU
+ * time of the process per iteration, and any counters the benchmark sets. The results can be written as JSON in the
+ * layout of Google Benchmark, so they can be compared between releases of the library with its compare.py tool.
+ *
+ * Command line options:
+ * - --benchmark_filter=<regex> runs only the benchmarks whose name matches.
+ * - --benchmark_min_time=<seconds> sets how long a run should take at least, 0.5s by default.
+ * - --benchmark_out=<file> writes the results as JSON.
+ */
+#pragma once
+
+#include <QDateTime>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QStringList>
+#include <QSysInfo>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/**
+ * @brief the CPU time the process has used so far, over all threads, in seconds.
+ */
+inline double processCpuSeconds()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0;
+    auto seconds = [](const FILETIME& time) { return (static_cast<uint64_t>(time.dwHighDateTime) << 32 | time.dwLowDateTime) * 1e-7; };
+    return seconds(kernel) + seconds(user);
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+/**
+ * @brief the value below which the given fraction of the values lie, 0 if there are none.
+ */
+inline double percentile(std::vector<double> values, double fraction)
+{
+    if (values.empty())
+        return 0;
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+/**
+ * The state of one run of a benchmark.
+ */
+class BenchmarkState {
+public:
+    explicit BenchmarkState(uint64_t iterations)
+        : m_iterations(iterations)
+    {
+    }
+
+    /**
+     * @brief true while there are iterations left. The clock starts on the first call and stops on the last.
+     */
+    bool keepRunning()
+    {
+        if (m_done == 0 && !m_started) {
+            m_started = true;
+            resumeTiming();
+        }
+        if (m_done < m_iterations) {
+            ++m_done;
+            return true;
+        }
+        pauseTiming();
+        return false;
+    }
+
+    uint64_t iterations() const { return m_iterations; }
+
+    /**
+     * @brief stops the clock, for work that should not be measured, such as preparing the input of the next iteration.
+     */
+    void pauseTiming()
+    {
+        // the CPU time is read outside the wall clock interval, so the wall clock does not measure reading it
+        if (m_running) {
+            m_elapsed += std::chrono::steady_clock::now() - m_start;
+            m_cpuSeconds += processCpuSeconds() - m_cpuStart;
+        }
+        m_running = false;
+    }
+
+    void resumeTiming()
+    {
+        m_cpuStart = processCpuSeconds();
+        m_start = std::chrono::steady_clock::now();
+        m_running = true;
+    }
+
+    /**
+     * @brief sets the number of items processed by the whole run, which is reported as items per second.
+     */
+    void setItemsProcessed(uint64_t items) { m_items = items; }
+
+    /**
+     * @brief marks the run as skipped, for example when it needs a device and none is connected.
+     */
+    void skip(const QString& reason)
+    {
+        m_skipped = reason;
+        m_iterations = 0;
+    }
+
+    /**
+     * @brief counters reported as they are, such as a latency percentile or the memory per channel.
+     */
+    std::map<QString, double> counters;
+
+    double elapsedSeconds() const { return std::chrono::duration<double>(m_elapsed).count(); }
+    /**
+     * @brief the CPU time of the whole process while the clock ran, including the threads of the library.
+     */
+    double cpuSeconds() const { return m_cpuSeconds; }
+    uint64_t itemsProcessed() const { return m_items; }
+    const QString& skipped() const { return m_skipped; }
+
+private:
+    uint64_t m_iterations;
+    uint64_t m_done = 0;
+    bool m_started = false;
+    bool m_running = false;
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::duration m_elapsed { 0 };
+    double m_cpuStart = 0;
+    double m_cpuSeconds = 0;
+    uint64_t m_items = 0;
+    QString m_skipped;
+};
+
+/**
+ * Registers benchmarks, runs them and reports the results.
+ */
+class BenchmarkRunner {
+public:
+    using Function = std::function<void(BenchmarkState&)>;
+
+    BenchmarkRunner(int argc, char* argv[])
+    {
+        for (int i = 1; i < argc; ++i) {
+            QString argument = argv[i];
+            if (argument.startsWith("--benchmark_filter="))
+                m_filter = QRegularExpression(argument.section('=', 1));
+            else if (argument.startsWith("--benchmark_min_time="))
+                m_minTime = argument.section('=', 1).toDouble();
+            else if (argument.startsWith("--benchmark_out="))
+                m_outputPath = argument.section('=', 1);
+            else
+                m_arguments << argument;
+        }
+    }
+
+    /**
+     * @brief the arguments that are not options of the runner.
+     */
+    const QStringList& arguments() const { return m_arguments; }
+
+    /**
+     * @brief adds a benchmark.
+     * @param fixedIterations if not 0, the benchmark always runs this many iterations, for work that takes long by itself.
+     */
+    void add(const QString& name, Function function, uint64_t fixedIterations = 0)
+    {
+        m_benchmarks.push_back({ name, std::move(function), fixedIterations });
+    }
+
+    /**
+     * @brief runs all benchmarks that match the filter and prints a line for each.
+     * @return the number of benchmarks run.
+     */
+    int run()
+    {
+        std::printf("%-48s %15s %15s %15s  %s\n", "Benchmark", "Time", "CPU", "Iterations", "Counters");
+        int count = 0;
+        for (const Benchmark& benchmark : m_benchmarks) {
+            if (!m_filter.match(benchmark.name).hasMatch())
+                continue;
+            ++count;
+
+            uint64_t iterations = benchmark.fixedIterations ? benchmark.fixedIterations : 1;
+            BenchmarkState state(iterations);
+            while (true) {
+                state = BenchmarkState(iterations);
+                benchmark.function(state);
+                if (!state.skipped().isEmpty() || benchmark.fixedIterations || state.elapsedSeconds() >= m_minTime || iterations >= 1000000000)
+                    break;
+                // aim past the minimum time, and grow at most tenfold at a time, as Google Benchmark does
+                double factor = state.elapsedSeconds() > 0 ? 1.4 * m_minTime / state.elapsedSeconds() : 10;
+                iterations = std::max<uint64_t>(iterations + 1, static_cast<uint64_t>(iterations * std::min(factor, 10.0)));
+            }
+            report(benchmark.name, state);
+        }
+        if (!m_outputPath.isEmpty())
+            write();
+        return count;
+    }
+
+private:
+    struct Benchmark {
+        QString name;
+        Function function;
+        uint64_t fixedIterations;
+    };
+
+    void report(const QString& name, const BenchmarkState& state)
+    {
+        QJsonObject result;
+        result["name"] = name;
+        result["run_type"] = "iteration";
+        if (!state.skipped().isEmpty()) {
+            std::printf("%-48s SKIPPED: %s\n", qPrintable(name), qPrintable(state.skipped()));
+            result["error_occurred"] = true;
+            result["error_message"] = state.skipped();
+            m_results.append(result);
+            return;
+        }
+
+        double nanoseconds = state.elapsedSeconds() * 1e9 / std::max<uint64_t>(state.iterations(), 1);
+        double cpuNanoseconds = state.cpuSeconds() * 1e9 / std::max<uint64_t>(state.iterations(), 1);
+        QString counters;
+        result["iterations"] = static_cast<qint64>(state.iterations());
+        result["real_time"] = nanoseconds;
+        result["cpu_time"] = cpuNanoseconds;
+        result["time_unit"] = "ns";
+        if (state.itemsProcessed() > 0 && state.elapsedSeconds() > 0) {
+            double rate = state.itemsProcessed() / state.elapsedSeconds();
+            result["items_per_second"] = rate;
+            counters += QString("items_per_second=%1/s ").arg(rate, 0, 'g', 4);
+        }
+        for (const auto& counter : state.counters) {
+            result[counter.first] = counter.second;
+            counters += QString("%1=%2 ").arg(counter.first).arg(counter.second, 0, 'g', 4);
+        }
+        std::printf("%-48s %12.0f ns %12.0f ns %15llu  %s\n", qPrintable(name), nanoseconds, cpuNanoseconds, static_cast<unsigned long long>(state.iterations()), qPrintable(counters));
+        std::fflush(stdout);
+        m_results.append(result);
+    }
+
+    void write()
+    {
+        QJsonObject context;
+        context["date"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+        context["host_name"] = QSysInfo::machineHostName();
+        context["num_cpus"] = static_cast<int>(std::thread::hardware_concurrency());
+        context["os"] = QSysInfo::prettyProductName();
+        // the build type of the benchmarks themselves; the one of the library is not known from its binaries
+#ifdef NDEBUG
+        context["benchmark_build_type"] = "release";
+#else
+        context["benchmark_build_type"] = "debug";
+#endif
+
+        QJsonObject output;
+        output["context"] = context;
+        output["benchmarks"] = m_results;
+        QFile file(m_outputPath);
+        if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(output).toJson()) < 0)
+            std::printf("Could not write %s\n", qPrintable(m_outputPath));
+    }
+
+    std::vector<Benchmark> m_benchmarks;
+    QRegularExpression m_filter { "." };
+    double m_minTime = 0.5;
+    QString m_outputPath;
+    QStringList m_arguments;
+    QJsonArray m_results;
+};
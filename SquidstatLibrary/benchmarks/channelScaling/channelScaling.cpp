@@ -0,0 +1,442 @@
+/**
+ * A load generator that finds how many channels one host can acquire from before samples arrive late or get lost.
+ *
+ * It raises the load step by step and reports, for each step, the sample rate offered and delivered, the delivery
+ * latency, the samples dropped and the CPU time per 1000 samples per second. At the end it names the last step that
+ * stayed within the limits.
+ *
+ * By default the load comes from simulated instruments: each has a thread of its own that produces the samples of its
+ * channels in packets, every millisecond, and hands every sample to the Qt event loop on its own, as a queued signal
+ * would. An instrument buffers at most one second of samples that the event loop has not taken yet, and drops the rest,
+ * as a device does when the host stops reading.
+ *
+ * With --devices, the steps use the instruments that are plugged in instead: one more instrument per step, through the
+ * normal AisDeviceTracker and AisInstrumentHandler signals. Drops are then found from gaps in the sample timestamps, and
+ * the latency is measured relative to the lowest latency seen on the channel, which removes the offset between the clocks
+ * of the host and the instrument.
+ *
+ * Options, besides those of benchmark.h:
+ * - --instruments=1,2,4 the numbers of simulated instruments to step through.
+ * - --channels=4 the channels used per instrument.
+ * - --interval=0.001 the sampling interval in seconds.
+ * - --ac-fraction=0 the fraction of the channels that run EIS instead of DC sampling.
+ * - --duration=5 the length of a step in seconds.
+ * - --latency-limit=50 the 99th percentile of the latency in milliseconds above which a step counts as overloaded.
+ * - --devices uses the plugged in instruments instead of simulated ones.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantPotElement.h"
+#include "experiments/builder_elements/AisEISPotentiostaticElement.h"
+
+#include "../benchmark.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include <atomic>
+#include <cmath>
+#include <memory>
+
+/**
+ * The load of one step.
+ */
+struct LoadLevel {
+    int instruments;
+    int channels; ///< per instrument.
+    double interval; ///< the DC sampling interval in seconds.
+    double acFraction; ///< the fraction of channels that produce AC data.
+    double duration; ///< in seconds.
+};
+
+/**
+ * What was measured during one step.
+ */
+struct LoadResult {
+    double offeredRate = 0; ///< the samples per second the instruments produced.
+    double deliveredRate = 0; ///< the samples per second that reached the slots.
+    uint64_t delivered = 0; ///< the samples that reached the slots while the CPU time was measured, including the backlog after the step.
+    uint64_t dropped = 0;
+    std::vector<double> latencies; ///< in milliseconds.
+    double cpuSeconds = 0;
+};
+
+// one DC or AC sample on its way to the event loop
+struct SimulatedSample {
+    uint8_t channel;
+    bool ac;
+    AisDCData dc;
+    AisACData acData;
+    std::chrono::steady_clock::time_point produced;
+};
+
+/**
+ * An instrument that produces samples on a thread of its own.
+ */
+class SimulatedInstrument {
+public:
+    static constexpr double AcInterval = 0.1; ///< an EIS channel reports a point this often, in seconds.
+
+    SimulatedInstrument(QObject* receiver, const LoadLevel& level, int acChannels, std::function<void(const SimulatedSample&)> slot)
+        : m_receiver(receiver)
+        , m_level(level)
+        , m_acChannels(acChannels)
+        , m_slot(std::move(slot))
+        , m_capacity(static_cast<uint64_t>(level.channels / level.interval) + 1)
+    {
+    }
+
+    ~SimulatedInstrument()
+    {
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    void start()
+    {
+        m_thread = std::thread([this]() { run(); });
+    }
+
+    bool finished() const { return m_finished.load(); }
+    uint64_t produced() const { return m_produced.load(); }
+    uint64_t dropped() const { return m_dropped.load(); }
+    uint64_t pending() const { return m_posted.load() - m_delivered.load(); }
+
+private:
+    void run()
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<uint64_t> next(m_level.channels, 0);
+        for (int packet = 1;; ++packet) {
+            // one packet per millisecond, with every sample that fell due since the previous one
+            double now = packet * 1e-3;
+            std::this_thread::sleep_until(start + std::chrono::microseconds(packet * 1000));
+            for (int channel = 0; channel < m_level.channels; ++channel) {
+                bool ac = channel < m_acChannels;
+                double interval = ac ? AcInterval : m_level.interval;
+                for (; next[channel] * interval < std::min(now, m_level.duration); ++next[channel])
+                    post(static_cast<uint8_t>(channel), ac, next[channel] * interval);
+            }
+            if (now >= m_level.duration)
+                break;
+        }
+        m_finished = true;
+    }
+
+    void post(uint8_t channel, bool ac, double timestamp)
+    {
+        ++m_produced;
+        if (pending() >= m_capacity) {
+            ++m_dropped;
+            return;
+        }
+        SimulatedSample sample {};
+        sample.channel = channel;
+        sample.ac = ac;
+        sample.dc = { timestamp, 0.1, -0.2, 1e-3, 25 };
+        sample.acData.timestamp = timestamp;
+        sample.acData.frequency = 1000;
+        sample.acData.absoluteImpedance = 10;
+        sample.produced = std::chrono::steady_clock::now();
+        ++m_posted;
+        QMetaObject::invokeMethod(m_receiver, [this, sample]() {
+            m_slot(sample);
+            ++m_delivered;
+        }, Qt::QueuedConnection);
+    }
+
+    QObject* m_receiver;
+    LoadLevel m_level;
+    int m_acChannels;
+    std::function<void(const SimulatedSample&)> m_slot;
+    uint64_t m_capacity; ///< the samples the instrument holds back at most.
+    std::thread m_thread;
+    std::atomic<bool> m_finished { false };
+    std::atomic<uint64_t> m_produced { 0 };
+    std::atomic<uint64_t> m_posted { 0 };
+    std::atomic<uint64_t> m_delivered { 0 };
+    std::atomic<uint64_t> m_dropped { 0 };
+};
+
+static int acChannelCount(const LoadLevel& level)
+{
+    return static_cast<int>(std::lround(level.acFraction * level.channels));
+}
+
+static LoadResult runSimulated(QObject* receiver, const LoadLevel& level)
+{
+    LoadResult result;
+    uint64_t delivered = 0;
+    bool measuring = true;
+    std::vector<std::vector<SimulatedSample>> lastSamples(level.instruments);
+    // the slot keeps the latest sample of every channel, like a live display would
+    auto slotFor = [&](int instrument) {
+        lastSamples[instrument].resize(level.channels);
+        return [&, instrument](const SimulatedSample& sample) {
+            lastSamples[instrument][sample.channel] = sample;
+            if (!measuring)
+                return;
+            result.latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sample.produced).count());
+            ++delivered;
+        };
+    };
+
+    std::vector<std::unique_ptr<SimulatedInstrument>> instruments;
+    for (int i = 0; i < level.instruments; ++i)
+        instruments.push_back(std::make_unique<SimulatedInstrument>(receiver, level, acChannelCount(level), slotFor(i)));
+
+    double cpuStart = processCpuSeconds();
+    QElapsedTimer wall;
+    wall.start();
+    for (auto& instrument : instruments)
+        instrument->start();
+
+    // run until every instrument is done and its samples have been delivered, or the backlog takes too long to clear
+    auto busy = [&]() {
+        for (auto& instrument : instruments) {
+            if (!instrument->finished() || instrument->pending() > 0)
+                return true;
+        }
+        return false;
+    };
+    while (busy() && wall.elapsed() < (level.duration + 10) * 1000)
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    result.cpuSeconds = processCpuSeconds() - cpuStart;
+    result.delivered = delivered;
+
+    uint64_t produced = 0;
+    for (auto& instrument : instruments) {
+        produced += instrument->produced();
+        result.dropped += instrument->dropped() + instrument->pending();
+    }
+    // the samples still queued refer to the instruments, so they are taken before the instruments go
+    measuring = false;
+    while (busy())
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    instruments.clear();
+
+    result.offeredRate = produced / level.duration;
+    result.deliveredRate = delivered / level.duration;
+    return result;
+}
+
+/**
+ * The plugged in instruments, for the steps with --devices.
+ */
+struct Devices {
+    std::vector<QString> names;
+    std::vector<const AisInstrumentHandler*> handlers;
+};
+
+static LoadResult runDevices(const Devices& devices, const LoadLevel& level)
+{
+    struct ChannelState {
+        double start = 0;
+        double minimumLatency = 1e9;
+        double lastTimestamp = -1;
+        std::vector<double> latencies;
+    };
+
+    LoadResult result;
+    uint64_t delivered = 0;
+    int running = 0;
+    std::map<std::pair<int, uint8_t>, ChannelState> channels;
+    std::vector<QMetaObject::Connection> connections;
+
+    AisConstantPotElement dcElement(0, level.interval, level.duration);
+    dcElement.setVoltageVsOCP(true);
+    AisExperiment dcExperiment;
+    dcExperiment.appendElement(dcElement, 1);
+    AisEISPotentiostaticElement acElement(10000, 1, 10, 0, 0.01);
+    AisExperiment acExperiment;
+    acExperiment.appendElement(acElement, 1);
+
+    double cpuStart = processCpuSeconds();
+    QElapsedTimer wall;
+    wall.start();
+
+    for (int device = 0; device < level.instruments; ++device) {
+        const AisInstrumentHandler* handler = devices.handlers[device];
+        auto received = [&, device, handler](uint8_t channel, double timestamp, bool ac) {
+            auto found = channels.find({ device, channel });
+            if (found == channels.end())
+                return;
+            ChannelState& state = found->second;
+            if (state.start == 0)
+                state.start = handler->getExperimentUTCStartTime(channel);
+            double latency = QDateTime::currentMSecsSinceEpoch() - (state.start + timestamp) * 1000;
+            state.minimumLatency = std::min(state.minimumLatency, latency);
+            state.latencies.push_back(latency);
+            if (!ac && state.lastTimestamp >= 0) {
+                double gap = timestamp - state.lastTimestamp;
+                if (gap > 1.5 * level.interval)
+                    result.dropped += static_cast<uint64_t>(std::llround(gap / level.interval)) - 1;
+            }
+            if (!ac)
+                state.lastTimestamp = timestamp;
+            ++delivered;
+        };
+        connections.push_back(QObject::connect(handler, &AisInstrumentHandler::activeDCDataReady, [=](uint8_t channel, const AisDCData& data) {
+            received(channel, data.timestamp, false);
+        }));
+        connections.push_back(QObject::connect(handler, &AisInstrumentHandler::activeACDataReady, [=](uint8_t channel, const AisACData& data) {
+            received(channel, data.timestamp, true);
+        }));
+        connections.push_back(QObject::connect(handler, &AisInstrumentHandler::experimentStopped, [&, device](uint8_t channel, const QString&) {
+            if (channels.count({ device, channel }))
+                --running;
+        }));
+
+        std::vector<uint8_t> free = handler->getFreeChannels();
+        int count = std::min<int>(level.channels, static_cast<int>(free.size()));
+        for (int i = 0; i < count; ++i) {
+            bool ac = i < static_cast<int>(std::lround(level.acFraction * count));
+            auto error = handler->uploadExperimentToChannel(free[i], ac ? acExperiment : dcExperiment);
+            if (!error)
+                error = handler->startUploadedExperiment(free[i]);
+            if (error) {
+                std::printf("%s channel %d: %s\n", qPrintable(devices.names[device]), free[i], qPrintable(error.message()));
+                continue;
+            }
+            channels[{ device, free[i] }];
+            ++running;
+            result.offeredRate += ac ? 0 : 1 / level.interval;
+        }
+    }
+
+    // an EIS channel is stopped with the DC channels, so a step takes as long on every channel
+    while (wall.elapsed() < level.duration * 1000)
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+    for (const auto& channel : channels)
+        devices.handlers[channel.first.first]->stopExperiment(channel.first.second);
+    while (running > 0 && wall.elapsed() < (level.duration + 30) * 1000)
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+    result.cpuSeconds = processCpuSeconds() - cpuStart;
+    result.delivered = delivered;
+
+    for (const QMetaObject::Connection& connection : connections)
+        QObject::disconnect(connection);
+    for (const auto& channel : channels) {
+        for (double latency : channel.second.latencies)
+            result.latencies.push_back(latency - channel.second.minimumLatency);
+    }
+    result.deliveredRate = delivered / level.duration;
+    return result;
+}
+
+static std::vector<int> parseList(const QString& text)
+{
+    std::vector<int> values;
+    for (const QString& value : text.split(',', Qt::SkipEmptyParts))
+        values.push_back(value.toInt());
+    return values;
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+    BenchmarkRunner runner(argc, argv);
+
+    std::vector<int> instrumentCounts = { 1, 2, 4, 8, 16, 32, 64 };
+    LoadLevel base { 1, 4, 0.001, 0, 5 };
+    double latencyLimit = 50;
+    bool useDevices = false;
+    for (const QString& argument : runner.arguments()) {
+        QString value = argument.section('=', 1);
+        if (argument.startsWith("--instruments="))
+            instrumentCounts = parseList(value);
+        else if (argument.startsWith("--channels="))
+            base.channels = value.toInt();
+        else if (argument.startsWith("--interval="))
+            base.interval = value.toDouble();
+        else if (argument.startsWith("--ac-fraction="))
+            base.acFraction = value.toDouble();
+        else if (argument.startsWith("--duration="))
+            base.duration = value.toDouble();
+        else if (argument.startsWith("--latency-limit="))
+            latencyLimit = value.toDouble();
+        else if (argument == "--devices")
+            useDevices = true;
+    }
+    if (base.channels < 1 || base.interval <= 0 || base.duration <= 0) {
+        std::printf("The channels, the interval and the duration have to be positive\n");
+        return 1;
+    }
+
+    Devices devices;
+    if (useDevices) {
+        auto tracker = AisDeviceTracker::Instance();
+        QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, [&](const QString& deviceName) {
+            devices.names.push_back(deviceName);
+            devices.handlers.push_back(&tracker->getInstrumentHandler(deviceName));
+        });
+        int expected = tracker->connectAllPluggedInDevices();
+        QElapsedTimer timeout;
+        timeout.start();
+        while (static_cast<int>(devices.handlers.size()) < expected && timeout.elapsed() < 10000)
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+        if (devices.handlers.empty()) {
+            std::printf("No instrument found\n");
+            return 1;
+        }
+        instrumentCounts.clear();
+        for (int count = 1; count <= static_cast<int>(devices.handlers.size()); ++count)
+            instrumentCounts.push_back(count);
+    }
+
+    struct Step {
+        LoadLevel level;
+        double deliveredRate;
+        bool overloaded;
+    };
+    std::vector<Step> steps;
+    QObject receiver;
+
+    for (int instruments : instrumentCounts) {
+        LoadLevel level = base;
+        level.instruments = instruments;
+        QString name = QString("ChannelScaling/%1/instruments:%2/channels:%3/interval_us:%4")
+                           .arg(useDevices ? "devices" : "simulated")
+                           .arg(instruments)
+                           .arg(level.channels)
+                           .arg(std::lround(level.interval * 1e6));
+        runner.add(name, [&, level](BenchmarkState& state) {
+            LoadResult result;
+            while (state.keepRunning())
+                result = useDevices ? runDevices(devices, level) : runSimulated(&receiver, level);
+
+            double p99 = percentile(result.latencies, 0.99);
+            bool overloaded = result.dropped > 0 || p99 > latencyLimit || result.deliveredRate < 0.95 * result.offeredRate;
+            steps.push_back({ level, result.deliveredRate, overloaded });
+
+            state.setItemsProcessed(result.delivered);
+            state.counters["offered_per_second"] = result.offeredRate;
+            state.counters["dropped"] = static_cast<double>(result.dropped);
+            state.counters["latency_p50_ms"] = percentile(result.latencies, 0.5);
+            state.counters["latency_p99_ms"] = p99;
+            state.counters["latency_max_ms"] = percentile(result.latencies, 1);
+            // the share of one core that 1000 samples per second take, from the CPU time and the samples of the same interval
+            state.counters["cpu_percent_per_1k"] = result.delivered > 0 ? 100 * result.cpuSeconds * 1000 / result.delivered : 0;
+        }, 1);
+    }
+
+    if (runner.run() == 0)
+        return 1;
+
+    // the limit is the last step that was not overloaded before the first one that was
+    const Step* limit = nullptr;
+    for (const Step& step : steps) {
+        if (step.overloaded)
+            break;
+        limit = &step;
+    }
+    if (!limit)
+        std::printf("Even the first step was overloaded: samples were dropped, late by more than %gms at the 99th percentile, or not delivered\n", latencyLimit);
+    else if (limit == &steps.back())
+        std::printf("No step was overloaded, up to %d instruments x %d channels at %.0f samples/s\n", limit->level.instruments, limit->level.channels, limit->deliveredRate);
+    else
+        std::printf("Scaling limit: %d instruments x %d channels at %.0f samples/s\n", limit->level.instruments, limit->level.channels, limit->deliveredRate);
+    return 0;
+}
@@ -0,0 +1,385 @@
+/**
+ * Benchmarks of the data acquisition path, to compare releases of the library before upgrading.
+ *
+ * Without a device, the benchmarks measure:
+ * - DCDelivery: samples handed from a reader thread to a slot on the Qt event loop, as AisDCData, at full speed and
+ *   at the pace of the device timestamps. The samples come from a simulated 10kHz device, or are replayed from a CSV
+ *   file written by the dataOutput example when --replay=<file> is given.
+ * - ExperimentBuild: building AisExperiment trees of many elements, flat and nested.
+ * - ExperimentCopy: copying such trees, as the examples do before an upload.
+ * - DataManipulator: feeding differential pulse samples through AisDataManipulator.
+ *
+ * With --device=<port>, the benchmarks that need a device run too: the rate and latency of activeDCDataReady, the
+ * upload time of large experiments, and the resident memory that connecting adds per channel.
+ */
+#include "AisDataManipulator.h"
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantCurrentElement.h"
+#include "experiments/builder_elements/AisConstantPotElement.h"
+#include "experiments/builder_elements/AisDiffPulseVoltammetryElement.h"
+#include "experiments/builder_elements/AisEISPotentiostaticElement.h"
+#include "experiments/builder_elements/AisOpenCircuitElement.h"
+
+#include "../benchmark.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+
+#include <atomic>
+#include <cmath>
+
+#if defined(_WIN32)
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+
+static constexpr double Pi = 3.14159265358979323846;
+
+// the resident memory of the process in bytes
+static double residentMemory()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    return K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#elif defined(__APPLE__)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+        return 0;
+    return info.resident_size;
+#else
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly))
+        return 0;
+    QList<QByteArray> fields = statm.readAll().split(' ');
+    return fields.size() > 1 ? fields[1].toDouble() * sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+/**
+ * Plays back DC samples from a thread of its own, the way the library hands samples from the port to the event loop.
+ */
+class ReplayDevice {
+public:
+    /**
+     * @brief a simulated device: a 10kHz sine of current on a constant potential.
+     */
+    ReplayDevice()
+    {
+        for (int i = 0; i < 10000; ++i)
+            m_samples.push_back({ i * 1e-4, 0.1, -0.2, 1e-3 * std::sin(2 * Pi * 50 * i * 1e-4), 25 });
+    }
+
+    /**
+     * @brief a device that replays a CSV file in the format of the dataOutput example.
+     */
+    bool load(const QString& path)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return false;
+        std::vector<AisDCData> samples;
+        QTextStream in(&file);
+        in.readLine();
+        while (!in.atEnd()) {
+            QStringList fields = in.readLine().split(',');
+            if (fields.size() >= 4)
+                samples.push_back({ fields[0].toDouble(), fields[2].toDouble(), fields[1].toDouble(), fields[3].toDouble(), 0 });
+        }
+        if (samples.size() < 2)
+            return false;
+        m_samples = std::move(samples);
+        return true;
+    }
+
+    /**
+     * @brief delivers samples to the slot on the thread of the receiver, and waits until all have arrived.
+     * @param paced if true the samples are sent at the pace of their timestamps, otherwise as fast as possible.
+     * @param latencies if not null, receives the time from sending to receiving each sample, in microseconds.
+     */
+    void play(QObject* receiver, uint64_t count, bool paced, const std::function<void(const AisDCData&)>& slot, std::vector<double>* latencies = nullptr)
+    {
+        std::atomic<uint64_t> received { 0 };
+        if (latencies)
+            latencies->reserve(latencies->size() + count);
+
+        std::thread reader([&]() {
+            auto start = std::chrono::steady_clock::now();
+            // the recording repeats after its length plus one sampling interval
+            const double length = m_samples.back().timestamp - m_samples.front().timestamp;
+            const double period = length * m_samples.size() / (m_samples.size() - 1);
+            for (uint64_t i = 0; i < count; ++i) {
+                const AisDCData& sample = m_samples[i % m_samples.size()];
+                if (paced) {
+                    // samples arrive in packets, so wait once per millisecond of device time rather than per sample
+                    double deviceTime = (i / m_samples.size()) * period + sample.timestamp - m_samples.front().timestamp;
+                    auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(deviceTime));
+                    if (due - std::chrono::steady_clock::now() > std::chrono::milliseconds(1))
+                        std::this_thread::sleep_until(due);
+                }
+                auto sent = std::chrono::steady_clock::now();
+                QMetaObject::invokeMethod(receiver, [&, sample, sent]() {
+                    slot(sample);
+                    if (latencies)
+                        latencies->push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent).count());
+                    ++received;
+                }, Qt::QueuedConnection);
+            }
+        });
+
+        while (received < count)
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 10);
+        reader.join();
+    }
+
+private:
+    std::vector<AisDCData> m_samples;
+};
+
+// an experiment of the given number of elements, cycling through common element types
+static std::shared_ptr<AisExperiment> buildExperiment(int elementCount)
+{
+    auto experiment = std::make_shared<AisExperiment>();
+    for (int i = 0; i < elementCount; ++i) {
+        switch (i % 4) {
+        case 0: {
+            AisOpenCircuitElement element(10, 1);
+            experiment->appendElement(element, 1);
+            break;
+        }
+        case 1: {
+            AisConstantPotElement element(0.1 + 1e-4 * i, 0.1, 60);
+            experiment->appendElement(element, 1);
+            break;
+        }
+        case 2: {
+            AisConstantCurrentElement element(1e-3, 0.1, 60);
+            element.setMaxVoltage(1.5);
+            experiment->appendElement(element, 1);
+            break;
+        }
+        default: {
+            AisEISPotentiostaticElement element(10000, 1, 10, 0, 0.01);
+            experiment->appendElement(element, 1);
+            break;
+        }
+        }
+    }
+    return experiment;
+}
+
+// a tree the given number of levels deep, with ten elements and the next level on each
+static std::shared_ptr<AisExperiment> buildNestedExperiment(int depth)
+{
+    auto experiment = buildExperiment(10);
+    if (depth > 1)
+        experiment->appendSubExperiment(*buildNestedExperiment(depth - 1), 2);
+    return experiment;
+}
+
+static void addOfflineBenchmarks(BenchmarkRunner& runner, QObject* receiver, std::shared_ptr<ReplayDevice> device)
+{
+    runner.add("DCDelivery/flood", [=](BenchmarkState& state) {
+        std::vector<AisDCData> stored;
+        stored.reserve(state.iterations());
+        while (state.keepRunning()) {
+        }
+        // all iterations are delivered in one go, since a single sample is too short to time
+        state.resumeTiming();
+        device->play(receiver, state.iterations(), false, [&](const AisDCData& data) { stored.push_back(data); });
+        state.pauseTiming();
+        state.setItemsProcessed(state.iterations());
+    });
+
+    runner.add("DCDelivery/paced", [=](BenchmarkState& state) {
+        std::vector<AisDCData> stored;
+        std::vector<double> latencies;
+        while (state.keepRunning()) {
+        }
+        state.resumeTiming();
+        device->play(receiver, state.iterations(), true, [&](const AisDCData& data) { stored.push_back(data); }, &latencies);
+        state.pauseTiming();
+        state.setItemsProcessed(state.iterations());
+        state.counters["latency_p50_us"] = percentile(latencies, 0.5);
+        state.counters["latency_p99_us"] = percentile(latencies, 0.99);
+        state.counters["latency_max_us"] = percentile(latencies, 1);
+    }, 30000);
+
+    for (int elementCount : { 100, 1000, 10000 }) {
+        runner.add(QString("ExperimentBuild/%1").arg(elementCount), [=](BenchmarkState& state) {
+            while (state.keepRunning())
+                buildExperiment(elementCount);
+            state.setItemsProcessed(state.iterations() * elementCount);
+        });
+    }
+    runner.add("ExperimentBuild/nested/20", [=](BenchmarkState& state) {
+        while (state.keepRunning())
+            buildNestedExperiment(20);
+        state.setItemsProcessed(state.iterations() * 200);
+    });
+
+    for (int elementCount : { 100, 10000 }) {
+        runner.add(QString("ExperimentCopy/%1").arg(elementCount), [=](BenchmarkState& state) {
+            auto experiment = buildExperiment(elementCount);
+            while (state.keepRunning())
+                std::make_shared<AisExperiment>(*experiment);
+            state.setItemsProcessed(state.iterations() * elementCount);
+        });
+    }
+
+    runner.add("DataManipulator/DPV", [=](BenchmarkState& state) {
+        // 1ms samples of a differential pulse waveform: 10mV steps, 50mV pulses 20ms wide every 100ms
+        AisDiffPulseVoltammetryElement element(-0.4, 0.5, 0.01, 0.05, 0.02, 0.1, 1e-3);
+        AisDataManipulator manipulator(element);
+        uint64_t pulses = 0;
+        uint64_t sample = 0;
+        while (state.keepRunning()) {
+            double time = sample++ * 1e-3;
+            double phase = std::fmod(time, 0.1);
+            double base = -0.4 + 0.01 * std::floor(time / 0.1);
+            double voltage = base + (phase >= 0.08 ? 0.05 : 0);
+            manipulator.loadPrimaryData({ time, voltage, 0, 1e-6 * voltage, 25 });
+            pulses += manipulator.isPulseCompleted();
+        }
+        state.setItemsProcessed(state.iterations());
+        state.counters["pulses"] = static_cast<double>(pulses);
+    });
+}
+
+/**
+ * The device that the device benchmarks run on.
+ */
+struct ConnectedDevice {
+    QString name;
+    const AisInstrumentHandler* handler = nullptr;
+    double memoryPerChannel = 0;
+};
+
+static void addDeviceBenchmarks(BenchmarkRunner& runner, std::shared_ptr<ConnectedDevice> device)
+{
+    const QString noDevice = "needs a device, pass --device=<port>";
+
+    runner.add("Device/MemoryPerChannel", [=](BenchmarkState& state) {
+        if (!device->handler)
+            return state.skip(noDevice);
+        while (state.keepRunning()) {
+        }
+        state.counters["bytes_per_channel"] = device->memoryPerChannel;
+    }, 1);
+
+    runner.add("Device/DCRate", [=](BenchmarkState& state) {
+        if (!device->handler)
+            return state.skip(noDevice);
+        const AisInstrumentHandler& handler = *device->handler;
+
+        // the fastest sampling the device accepts, for 10 seconds
+        AisConstantPotElement element(0.0, 0.0001, 10);
+        element.setVoltageVsOCP(true);
+        auto experiment = std::make_shared<AisExperiment>();
+        experiment->appendElement(element, 1);
+
+        uint64_t samples = 0;
+        std::vector<double> latencies;
+        bool stopped = false;
+        double experimentStart = 0;
+        auto dataConnection = QObject::connect(&handler, &AisInstrumentHandler::activeDCDataReady, [&](uint8_t channel, const AisDCData& data) {
+            if (channel != 0)
+                return;
+            ++samples;
+            if (experimentStart == 0)
+                experimentStart = handler.getExperimentUTCStartTime(0);
+            // includes the offset between the clocks of the host and the device
+            latencies.push_back(QDateTime::currentMSecsSinceEpoch() * 1e3 - (experimentStart + data.timestamp) * 1e6);
+        });
+        auto stopConnection = QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [&](uint8_t channel, const QString&) {
+            stopped |= channel == 0;
+        });
+
+        auto error = handler.uploadExperimentToChannel(0, experiment);
+        if (!error)
+            error = handler.startUploadedExperiment(0);
+        if (error) {
+            state.skip(error.message());
+        } else {
+            while (state.keepRunning()) {
+                while (!stopped)
+                    QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+            }
+            state.setItemsProcessed(samples);
+            state.counters["latency_p50_us"] = percentile(latencies, 0.5);
+            state.counters["latency_p99_us"] = percentile(latencies, 0.99);
+        }
+        QObject::disconnect(dataConnection);
+        QObject::disconnect(stopConnection);
+    }, 1);
+
+    for (int elementCount : { 10, 100, 1000 }) {
+        runner.add(QString("Device/Upload/%1").arg(elementCount), [=](BenchmarkState& state) {
+            if (!device->handler)
+                return state.skip(noDevice);
+            auto experiment = buildExperiment(elementCount);
+            while (state.keepRunning()) {
+                auto error = device->handler->uploadExperimentToChannel(0, experiment);
+                if (error)
+                    return state.skip(error.message());
+            }
+            state.setItemsProcessed(state.iterations() * elementCount);
+        }, 5);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+    BenchmarkRunner runner(argc, argv);
+
+    QString replayPath;
+    QString port;
+    for (const QString& argument : runner.arguments()) {
+        if (argument.startsWith("--replay="))
+            replayPath = argument.section('=', 1);
+        else if (argument.startsWith("--device="))
+            port = argument.section('=', 1);
+    }
+
+    auto replay = std::make_shared<ReplayDevice>();
+    if (!replayPath.isEmpty() && !replay->load(replayPath)) {
+        std::printf("Could not replay %s\n", qPrintable(replayPath));
+        return 1;
+    }
+
+    auto device = std::make_shared<ConnectedDevice>();
+    if (!port.isEmpty()) {
+        auto tracker = AisDeviceTracker::Instance();
+        double memoryBefore = residentMemory();
+        QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, [&](const QString& deviceName) {
+            device->name = deviceName;
+            device->handler = &tracker->getInstrumentHandler(deviceName);
+        });
+        auto error = tracker->connectToDeviceOnComPort(port);
+        QElapsedTimer timeout;
+        timeout.start();
+        while (!error && !device->handler && timeout.elapsed() < 10000)
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+        if (error || !device->handler) {
+            std::printf("Could not connect to %s: %s\n", qPrintable(port), error ? qPrintable(error.message()) : "timed out");
+            return 1;
+        }
+        int channels = std::max(1, device->handler->getNumberOfChannels());
+        device->memoryPerChannel = (residentMemory() - memoryBefore) / channels;
+        std::printf("Connected to %s with %d channels\n", qPrintable(device->name), channels);
+    }
+
+    QObject receiver;
+    addOfflineBenchmarks(runner, &receiver, replay);
+    addDeviceBenchmarks(runner, device);
+    return runner.run() > 0 ? 0 : 1;
+}
@@ -0,0 +1,360 @@
+/**
+ * A logger that keeps the cost of logging on the data path to tens of nanoseconds, so it can stay enabled.
+ *
+ * Every thread that logs gets its own ring of fixed size records. Logging copies the id of a format string and up to
+ * six arguments into the ring, without locks, allocations or formatting. A background thread moves the records into a
+ * binary file, and binaryLogDecoder turns the file into text afterwards.
+ *
+ * The file holds a header followed by entries, each starting with a kind byte:
+ * - a format: its id and its text, in which every {} is replaced by the next argument when decoding.
+ * - a string: its id and its text, for arguments that are text, such as device names.
+ * - a record: a `LogRecord`.
+ * - a drop: the number of records that a thread lost because its ring was full.
+ * All numbers are stored in the byte order of the machine that wrote the file.
+ */
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace BinaryLog {
+
+static constexpr char Magic[8] = { 'A', 'I', 'S', 'B', 'L', 'O', 'G', '1' };
+
+enum EntryKind : uint8_t {
+    FormatEntry = 1,
+    StringEntry = 2,
+    RecordEntry = 3,
+    DropEntry = 4
+};
+
+enum ArgumentType : uint8_t {
+    Signed = 0,
+    Unsigned = 1,
+    Double = 2,
+    String = 3 ///< the id of a string from AsyncBinaryLogger::internString.
+};
+
+static constexpr size_t MaxArguments = 6;
+
+struct FileHeader {
+    char magic[8];
+    int64_t steadyStart; ///< the steady clock at the start of the log, in nanoseconds.
+    int64_t utcStart; ///< the UTC time at the start of the log, in milliseconds since the Unix Epoch.
+};
+
+struct LogRecord {
+    uint64_t timestamp; ///< the steady clock in nanoseconds.
+    uint16_t format;
+    uint8_t thread;
+    uint8_t argumentCount;
+    uint16_t argumentTypes; ///< two bits per argument.
+    uint16_t reserved;
+    uint64_t arguments[MaxArguments]; ///< the bits of each argument.
+};
+static_assert(sizeof(LogRecord) == 64, "a record should fill one cache line");
+
+/**
+ * The id of an interned string, to log text without copying it.
+ */
+struct StringId {
+    uint32_t id;
+};
+
+inline int64_t steadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * A ring of records with a single producer and a single consumer.
+ */
+class RecordRing {
+public:
+    static constexpr size_t Capacity = 16384; ///< records, a power of two.
+
+    bool push(const LogRecord& record)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_cachedTail >= Capacity) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head - m_cachedTail >= Capacity) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        m_records[head & (Capacity - 1)] = record;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief moves all records that are ready to the end of the buffer.
+     * @return the number of records moved.
+     */
+    size_t drain(QByteArray& buffer)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t head = m_head.load(std::memory_order_acquire);
+        for (size_t i = tail; i != head; ++i) {
+            buffer.append(static_cast<char>(RecordEntry));
+            buffer.append(reinterpret_cast<const char*>(&m_records[i & (Capacity - 1)]), sizeof(LogRecord));
+        }
+        m_tail.store(head, std::memory_order_release);
+        return head - tail;
+    }
+
+    uint64_t takeDropped() { return m_dropped.exchange(0, std::memory_order_relaxed); }
+
+private:
+    alignas(64) std::atomic<size_t> m_head { 0 };
+    size_t m_cachedTail = 0; ///< the producer's copy of the tail, to avoid touching the consumer's cache line.
+    alignas(64) std::atomic<size_t> m_tail { 0 };
+    alignas(64) std::atomic<uint64_t> m_dropped { 0 };
+    std::array<LogRecord, Capacity> m_records;
+};
+
+/**
+ * Writes records logged from any number of threads to a binary file on a background thread.
+ */
+class AsyncBinaryLogger {
+public:
+    /**
+     * @param path the file to write to. It is replaced if it exists.
+     */
+    explicit AsyncBinaryLogger(const QString& path)
+        : m_file(path)
+    {
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return;
+        FileHeader header;
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.steadyStart = steadyNanoseconds();
+        header.utcStart = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        m_writer = std::thread([this]() { run(); });
+    }
+
+    ~AsyncBinaryLogger()
+    {
+        m_stop.store(true);
+        if (m_writer.joinable())
+            m_writer.join();
+    }
+
+    AsyncBinaryLogger(const AsyncBinaryLogger&) = delete;
+    AsyncBinaryLogger& operator=(const AsyncBinaryLogger&) = delete;
+
+    bool isOpen() const { return m_file.isOpen(); }
+
+    /**
+     * @brief registers a format. Do this once, outside of the data path, and keep the id.
+     * @param format the text of the records, with {} where each argument goes.
+     */
+    uint16_t registerFormat(const QString& format)
+    {
+        std::lock_guard<std::mutex> lock(m_tableMutex);
+        m_formats.push_back(format);
+        return static_cast<uint16_t>(m_formats.size() - 1);
+    }
+
+    /**
+     * @brief gives a string an id that can be logged in its place. The same string always gets the same id.
+     */
+    StringId internString(const QString& text)
+    {
+        std::lock_guard<std::mutex> lock(m_tableMutex);
+        auto found = m_stringIds.find(text);
+        if (found != m_stringIds.end())
+            return { found.value() };
+        uint32_t id = static_cast<uint32_t>(m_strings.size());
+        m_strings.push_back(text);
+        m_stringIds.insert(text, id);
+        return { id };
+    }
+
+    /**
+     * @brief logs a record. This never blocks: if the ring of the calling thread is full, the record is dropped and counted.
+     * @param args up to six integers, floating point numbers or `StringId`s.
+     * @return false if the record was dropped.
+     */
+    template <typename... Args>
+    bool log(uint16_t format, Args... args)
+    {
+        static_assert(sizeof...(Args) <= MaxArguments, "a record holds at most six arguments");
+        uint8_t thread;
+        RecordRing* ring = threadRing(thread);
+        if (!ring)
+            return false;
+
+        LogRecord record {};
+        record.timestamp = steadyNanoseconds();
+        record.format = format;
+        record.thread = thread;
+        record.argumentCount = sizeof...(Args);
+        size_t index = 0;
+        (store(record, index++, args), ...);
+        return ring->push(record);
+    }
+
+    /**
+     * @brief the number of records lost because a ring was full, over all threads, until the last write.
+     */
+    uint64_t droppedRecords() const { return m_totalDropped.load(); }
+
+    /**
+     * @brief the number of records written to the file so far.
+     */
+    uint64_t writtenRecords() const { return m_totalWritten.load(); }
+
+private:
+    template <typename T>
+    static void store(LogRecord& record, size_t index, T value)
+    {
+        uint64_t bits = 0;
+        ArgumentType type;
+        if constexpr (std::is_same_v<T, StringId>) {
+            bits = value.id;
+            type = String;
+        } else if constexpr (std::is_floating_point_v<T>) {
+            double number = value;
+            std::memcpy(&bits, &number, sizeof(bits));
+            type = Double;
+        } else if constexpr (std::is_signed_v<T>) {
+            int64_t number = value;
+            std::memcpy(&bits, &number, sizeof(bits));
+            type = Signed;
+        } else {
+            static_assert(std::is_unsigned_v<T>, "only numbers and StringIds can be logged");
+            bits = value;
+            type = Unsigned;
+        }
+        record.arguments[index] = bits;
+        record.argumentTypes |= static_cast<uint16_t>(type << (2 * index));
+    }
+
+    // the ring of the calling thread is created on its first record; afterwards logging touches no shared state
+    // except the ring. A thread keeps one ring, so it should log to a single logger.
+    static uint64_t nextId()
+    {
+        static std::atomic<uint64_t> id { 0 };
+        return ++id;
+    }
+
+    RecordRing* threadRing(uint8_t& index)
+    {
+        thread_local uint64_t owner = 0;
+        thread_local RecordRing* ring = nullptr;
+        thread_local uint8_t ringIndex = 0;
+        if (owner != m_id) {
+            std::lock_guard<std::mutex> lock(m_ringMutex);
+            if (m_rings.size() > UINT8_MAX || !m_file.isOpen())
+                return nullptr;
+            m_rings.push_back(std::make_unique<RecordRing>());
+            ring = m_rings.back().get();
+            ringIndex = static_cast<uint8_t>(m_rings.size() - 1);
+            m_ringCount.store(m_rings.size(), std::memory_order_release);
+            owner = m_id;
+        }
+        index = ringIndex;
+        return ring;
+    }
+
+    void run()
+    {
+        QByteArray buffer;
+        size_t formatsWritten = 0;
+        size_t stringsWritten = 0;
+        bool stopping = false;
+        while (!stopping) {
+            stopping = m_stop.load();
+            buffer.clear();
+
+            // the records are collected first: a format or string used by a record was registered before it was
+            // logged, so the tables read below hold everything the records refer to
+            QByteArray records;
+            uint64_t written = 0;
+            std::vector<uint64_t> dropped;
+            size_t ringCount = m_ringCount.load(std::memory_order_acquire);
+            for (size_t i = 0; i < ringCount; ++i) {
+                RecordRing* ring;
+                {
+                    std::lock_guard<std::mutex> lock(m_ringMutex);
+                    ring = m_rings[i].get();
+                }
+                written += ring->drain(records);
+                dropped.push_back(ring->takeDropped());
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_tableMutex);
+                for (; formatsWritten < m_formats.size(); ++formatsWritten)
+                    appendText(buffer, FormatEntry, static_cast<uint32_t>(formatsWritten), m_formats[formatsWritten]);
+                for (; stringsWritten < m_strings.size(); ++stringsWritten)
+                    appendText(buffer, StringEntry, static_cast<uint32_t>(stringsWritten), m_strings[stringsWritten]);
+            }
+            buffer.append(records);
+            for (size_t i = 0; i < dropped.size(); ++i) {
+                if (dropped[i] == 0)
+                    continue;
+                uint32_t thread = static_cast<uint32_t>(i);
+                buffer.append(static_cast<char>(DropEntry));
+                buffer.append(reinterpret_cast<const char*>(&thread), sizeof(thread));
+                buffer.append(reinterpret_cast<const char*>(&dropped[i]), sizeof(dropped[i]));
+                m_totalDropped += dropped[i];
+            }
+
+            if (!buffer.isEmpty()) {
+                m_file.write(buffer);
+                m_file.flush();
+                m_totalWritten += written;
+            }
+            // sleep only when there was little to do, so a burst is written without delay
+            if (written < RecordRing::Capacity / 4 && !stopping)
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        m_file.close();
+    }
+
+    static void appendText(QByteArray& buffer, EntryKind kind, uint32_t id, const QString& text)
+    {
+        QByteArray utf8 = text.toUtf8();
+        uint32_t length = static_cast<uint32_t>(utf8.size());
+        buffer.append(static_cast<char>(kind));
+        buffer.append(reinterpret_cast<const char*>(&id), sizeof(id));
+        buffer.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        buffer.append(utf8);
+    }
+
+    QFile m_file;
+    std::thread m_writer;
+    std::atomic<bool> m_stop { false };
+
+    std::mutex m_ringMutex;
+    std::vector<std::unique_ptr<RecordRing>> m_rings;
+    std::atomic<size_t> m_ringCount { 0 };
+    const uint64_t m_id = nextId();
+
+    std::mutex m_tableMutex;
+    std::vector<QString> m_formats;
+    std::vector<QString> m_strings;
+    QHash<QString, uint32_t> m_stringIds;
+
+    std::atomic<uint64_t> m_totalDropped { 0 };
+    std::atomic<uint64_t> m_totalWritten { 0 };
+};
+
+} // namespace BinaryLog
@@ -0,0 +1,161 @@
+/**
+ * \example binaryLogDecoder.cpp
+ * This tool turns a log written by `BinaryLog::AsyncBinaryLogger` into text, one line per record:
+ *
+ *     2026-10-19T09:30:12.123456 [thread 2] Plus2001 channel 0: 12.34s 1.2e-05A 0.1V
+ *
+ * Usage: binaryLogDecoder <log file> [output file]. The text goes to the standard output if no output file is given.
+ */
+#include "binaryLog.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QTextStream>
+
+#include <cstdio>
+#include <map>
+
+using namespace BinaryLog;
+
+// reads a value of type T at the offset, and moves the offset past it
+template <typename T>
+static bool read(const QByteArray& data, int& offset, T& value)
+{
+    if (offset + static_cast<int>(sizeof(T)) > data.size())
+        return false;
+    std::memcpy(&value, data.constData() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+static bool readText(const QByteArray& data, int& offset, uint32_t& id, QString& text)
+{
+    uint32_t length;
+    if (!read(data, offset, id) || !read(data, offset, length) || offset + static_cast<qint64>(length) > data.size())
+        return false;
+    text = QString::fromUtf8(data.constData() + offset, static_cast<int>(length));
+    offset += length;
+    return true;
+}
+
+static QString argumentText(const LogRecord& record, size_t index, const std::map<uint32_t, QString>& strings)
+{
+    uint64_t bits = record.arguments[index];
+    switch ((record.argumentTypes >> (2 * index)) & 3) {
+    case Signed: {
+        int64_t value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return QString::number(value);
+    }
+    case Unsigned:
+        return QString::number(bits);
+    case Double: {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return QString::number(value, 'g', 10);
+    }
+    default: {
+        auto found = strings.find(static_cast<uint32_t>(bits));
+        return found != strings.end() ? found->second : QString("<string %1>").arg(bits);
+    }
+    }
+}
+
+// replaces every {} of the format by the next argument, and appends the arguments that are left over
+static QString formatRecord(const QString& format, const LogRecord& record, const std::map<uint32_t, QString>& strings)
+{
+    QString text;
+    size_t argument = 0;
+    int position = 0;
+    for (int found; (found = format.indexOf("{}", position)) >= 0; position = found + 2) {
+        text += format.midRef(position, found - position);
+        text += argument < record.argumentCount ? argumentText(record, argument++, strings) : QString("{}");
+    }
+    text += format.midRef(position);
+    for (; argument < record.argumentCount; ++argument)
+        text += " " + argumentText(record, argument, strings);
+    return text;
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+    if (argc < 2) {
+        qDebug() << "Usage: binaryLogDecoder <log file> [output file]";
+        return 1;
+    }
+
+    QFile input(argv[1]);
+    if (!input.open(QIODevice::ReadOnly)) {
+        qDebug() << "Could not open" << argv[1];
+        return 1;
+    }
+    const QByteArray data = input.readAll();
+
+    QFile output;
+    if (argc > 2) {
+        output.setFileName(argv[2]);
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            qDebug() << "Could not open" << argv[2];
+            return 1;
+        }
+    } else {
+        output.open(stdout, QIODevice::WriteOnly | QIODevice::Text);
+    }
+    QTextStream out(&output);
+
+    int offset = 0;
+    FileHeader header;
+    if (!read(data, offset, header) || std::memcmp(header.magic, Magic, sizeof(Magic)) != 0) {
+        qDebug() << argv[1] << "is not a binary log";
+        return 1;
+    }
+
+    std::map<uint32_t, QString> formats;
+    std::map<uint32_t, QString> strings;
+    uint64_t records = 0;
+    uint64_t dropped = 0;
+    while (offset < data.size()) {
+        uint8_t kind;
+        read(data, offset, kind);
+        bool complete = false;
+        if (kind == FormatEntry || kind == StringEntry) {
+            uint32_t id;
+            QString text;
+            complete = readText(data, offset, id, text);
+            (kind == FormatEntry ? formats : strings)[id] = text;
+        } else if (kind == RecordEntry) {
+            LogRecord record;
+            complete = read(data, offset, record);
+            if (complete) {
+                // the timestamps are on the steady clock of the writer, which the header ties to UTC
+                qint64 microseconds = header.utcStart * 1000 + (static_cast<int64_t>(record.timestamp) - header.steadyStart) / 1000;
+                QDateTime time = QDateTime::fromMSecsSinceEpoch(microseconds / 1000, Qt::UTC);
+                auto format = formats.find(record.format);
+                out << time.toString("yyyy-MM-ddTHH:mm:ss.zzz") << QString("%1").arg(microseconds % 1000, 3, 10, QChar('0'))
+                    << " [thread " << record.thread << "] "
+                    << formatRecord(format != formats.end() ? format->second : QString("<format %1>").arg(record.format), record, strings) << "\n";
+                ++records;
+            }
+        } else if (kind == DropEntry) {
+            uint32_t thread;
+            uint64_t count;
+            complete = read(data, offset, thread) && read(data, offset, count);
+            if (complete) {
+                out << "[thread " << thread << "] " << count << " records dropped\n";
+                dropped += count;
+            }
+        }
+        if (!complete) {
+            // the writer was stopped in the middle of an entry, or the file is damaged
+            qDebug() << "The log ends with an incomplete entry at byte" << offset;
+            break;
+        }
+    }
+
+    out.flush();
+    qDebug() << records << "records decoded," << dropped << "dropped";
+    return 0;
+}
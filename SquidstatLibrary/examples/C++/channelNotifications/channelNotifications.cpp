@@ -0,0 +1,351 @@
+/**
+ * \example channelNotifications.cpp
+ * This example shows how to wait for channels without busy polling AisInstrumentHandler::isChannelBusy, as
+ * nonblockingExperiment.cpp does.
+ *
+ * `ChannelNotifier` follows the state of every channel from the signals of the handler and offers two ways to wait:
+ * - ChannelNotifier::waitForExperimentStopped blocks the calling thread on a condition variable until the experiment on
+ *   a channel has stopped, or until a timeout.
+ * - ChannelNotifier::nativeHandle gives a handle per channel that is signalled on every state change: an eventfd on
+ *   Linux, the read end of a pipe on macOS and an event object on Windows. An orchestrator can wait on the handles of
+ *   hundreds of channels with one poll() or WaitForMultipleObjects() call and uses no CPU while nothing changes.
+ *   WaitForMultipleObjects() takes at most 64 handles, so on Windows ChannelNotifier::changeHandle gives one more event
+ *   that is signalled on a change of any channel; a wait on it covers every channel of the handler, however many.
+ *
+ * The signals are delivered on the thread that runs the Qt event loop, so the waiting has to happen on another thread.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantPotElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+
+enum class ChannelState {
+    Idle,
+    Running,
+    Paused
+};
+
+/**
+ * Tracks the state of every channel of a handler and wakes up threads that wait on it.
+ */
+class ChannelNotifier {
+public:
+#ifdef _WIN32
+    using NativeHandle = HANDLE;
+#else
+    using NativeHandle = int;
+#endif
+
+    explicit ChannelNotifier(const AisInstrumentHandler& handler)
+        : m_channels(std::max(0, handler.getNumberOfChannels()))
+    {
+#ifdef _WIN32
+        m_changeHandle = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+#endif
+        for (uint8_t channel = 0; channel < m_channels.size(); ++channel) {
+            Channel& state = m_channels[channel];
+            state.state = handler.isChannelBusy(channel) ? ChannelState::Running : ChannelState::Idle;
+#if defined(_WIN32)
+            state.handle = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+#elif defined(__linux__)
+            state.handle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+            int fds[2] = { -1, -1 };
+            if (pipe(fds) == 0) {
+                for (int fd : fds)
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            }
+            state.handle = fds[0];
+            state.writeHandle = fds[1];
+#endif
+        }
+
+        m_connections.push_back(QObject::connect(&handler, &AisInstrumentHandler::experimentNewElementStarting, [this](uint8_t channel, const AisExperimentNode&) {
+            setState(channel, ChannelState::Running, true);
+        }));
+        m_connections.push_back(QObject::connect(&handler, &AisInstrumentHandler::experimentResumed, [this](uint8_t channel) {
+            setState(channel, ChannelState::Running, false);
+        }));
+        m_connections.push_back(QObject::connect(&handler, &AisInstrumentHandler::experimentPaused, [this](uint8_t channel) {
+            setState(channel, ChannelState::Paused, false);
+        }));
+        m_connections.push_back(QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [this](uint8_t channel, const QString&) {
+            setState(channel, ChannelState::Idle, false);
+        }));
+    }
+
+    ~ChannelNotifier()
+    {
+        for (const QMetaObject::Connection& connection : m_connections)
+            QObject::disconnect(connection);
+#ifdef _WIN32
+        if (m_changeHandle)
+            CloseHandle(m_changeHandle);
+#endif
+        for (Channel& channel : m_channels) {
+#ifdef _WIN32
+            if (channel.handle)
+                CloseHandle(channel.handle);
+#else
+            if (channel.handle >= 0)
+                close(channel.handle);
+            if (channel.writeHandle >= 0)
+                close(channel.writeHandle);
+#endif
+        }
+    }
+
+    ChannelNotifier(const ChannelNotifier&) = delete;
+    ChannelNotifier& operator=(const ChannelNotifier&) = delete;
+
+    size_t channelCount() const { return m_channels.size(); }
+
+    /**
+     * @brief marks a channel as running. Call this right after AisInstrumentHandler::startUploadedExperiment succeeds,
+     * so that a wait that begins before the first element has started does not return straight away.
+     */
+    void experimentStarted(uint8_t channel) { setState(channel, ChannelState::Running, false); }
+
+    ChannelState state(uint8_t channel) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return channel < m_channels.size() ? m_channels[channel].state : ChannelState::Idle;
+    }
+
+    /**
+     * @brief the number of experiments that have stopped on the channel so far.
+     */
+    unsigned int stopCount(uint8_t channel) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return channel < m_channels.size() ? m_channels[channel].stopCount : 0;
+    }
+
+    /**
+     * @brief blocks until the channel is idle.
+     * @return false if the channel was still running or paused when the timeout expired.
+     * @note do not call this from the thread that runs the Qt event loop, since that thread delivers the stop.
+     */
+    bool waitForExperimentStopped(uint8_t channel, std::chrono::milliseconds timeout)
+    {
+        if (channel >= m_channels.size())
+            return true;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_changed.wait_for(lock, timeout, [&]() { return m_channels[channel].state == ChannelState::Idle; });
+    }
+
+    /**
+     * @brief a handle that is signalled whenever the state of the channel changes. Call acknowledge() once it is.
+     */
+    NativeHandle nativeHandle(uint8_t channel) const { return m_channels[channel].handle; }
+
+#ifdef _WIN32
+    /**
+     * @brief an event that is signalled whenever the state of any channel changes, after the handle of that channel.
+     * The handles of the channels that changed are still signalled when a wait on this event returns.
+     */
+    HANDLE changeHandle() const { return m_changeHandle; }
+#endif
+
+    /**
+     * @brief resets the handle of a channel after it was signalled.
+     * @return the current state of the channel.
+     */
+    ChannelState acknowledge(uint8_t channel)
+    {
+#if defined(_WIN32)
+        // the event resets itself when a wait returns on it
+#elif defined(__linux__)
+        uint64_t count;
+        while (read(m_channels[channel].handle, &count, sizeof(count)) > 0) {
+        }
+#else
+        char buffer[64];
+        while (read(m_channels[channel].handle, buffer, sizeof(buffer)) > 0) {
+        }
+#endif
+        return state(channel);
+    }
+
+private:
+    struct Channel {
+        ChannelState state = ChannelState::Idle;
+        unsigned int stopCount = 0;
+#ifdef _WIN32
+        HANDLE handle = nullptr;
+#else
+        int handle = -1;
+        int writeHandle = -1;
+#endif
+    };
+
+    void setState(uint8_t channel, ChannelState state, bool notifyAlways)
+    {
+        if (channel >= m_channels.size())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Channel& current = m_channels[channel];
+            if (current.state == state && !notifyAlways)
+                return;
+            current.state = state;
+            if (state == ChannelState::Idle)
+                ++current.stopCount;
+        }
+        m_changed.notify_all();
+
+#if defined(_WIN32)
+        SetEvent(m_channels[channel].handle);
+        SetEvent(m_changeHandle);
+#elif defined(__linux__)
+        uint64_t one = 1;
+        (void)!write(m_channels[channel].handle, &one, sizeof(one));
+#else
+        char byte = 1;
+        (void)!write(m_channels[channel].writeHandle, &byte, 1);
+#endif
+    }
+
+    std::vector<Channel> m_channels;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::vector<QMetaObject::Connection> m_connections;
+#ifdef _WIN32
+    HANDLE m_changeHandle = nullptr;
+#endif
+};
+
+// waits on the handles of all channels until none is running, without spinning
+static void orchestrate(ChannelNotifier& notifier, std::vector<uint8_t> channels)
+{
+    size_t remaining = channels.size();
+    while (remaining > 0) {
+#ifdef _WIN32
+        std::vector<uint8_t> ready;
+        if (channels.size() <= MAXIMUM_WAIT_OBJECTS) {
+            std::vector<HANDLE> handles;
+            for (uint8_t channel : channels)
+                handles.push_back(notifier.nativeHandle(channel));
+            DWORD result = WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), FALSE, INFINITE);
+            if (result < WAIT_OBJECT_0 + handles.size())
+                ready.push_back(channels[result - WAIT_OBJECT_0]);
+        } else {
+            // more handles than WaitForMultipleObjects takes: wait for a change of any channel, then find the channels
+            // whose handles are signalled, which also resets them
+            if (WaitForSingleObject(notifier.changeHandle(), INFINITE) != WAIT_OBJECT_0)
+                return;
+            for (uint8_t channel : channels) {
+                if (WaitForSingleObject(notifier.nativeHandle(channel), 0) == WAIT_OBJECT_0)
+                    ready.push_back(channel);
+            }
+        }
+#else
+        std::vector<pollfd> fds;
+        for (uint8_t channel : channels)
+            fds.push_back({ notifier.nativeHandle(channel), POLLIN, 0 });
+        if (poll(fds.data(), fds.size(), -1) < 0)
+            return;
+        std::vector<uint8_t> ready;
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if (fds[i].revents & POLLIN)
+                ready.push_back(channels[i]);
+        }
+#endif
+        for (uint8_t channel : ready) {
+            ChannelState state = notifier.acknowledge(channel);
+            qDebug() << "Channel" << channel << (state == ChannelState::Idle ? "stopped" : state == ChannelState::Paused ? "paused" : "running");
+            if (state == ChannelState::Idle) {
+                channels.erase(std::find(channels.begin(), channels.end(), channel));
+                --remaining;
+            }
+        }
+    }
+}
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // hold 0.1V for 30 seconds on every channel
+    AisConstantPotElement cvElement(0.1, 1, 30);
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendElement(cvElement, 1);
+
+    std::vector<std::thread> threads;
+    std::vector<std::shared_ptr<ChannelNotifier>> notifiers;
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [&](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        auto notifier = std::make_shared<ChannelNotifier>(handler);
+        notifiers.push_back(notifier);
+
+        std::vector<uint8_t> started;
+        for (uint8_t channel : handler.getFreeChannels()) {
+            auto error = handler.uploadExperimentToChannel(channel, experiment);
+            if (!error)
+                error = handler.startUploadedExperiment(channel);
+            if (error) {
+                qDebug() << "Channel" << channel << ":" << error.message();
+                continue;
+            }
+            notifier->experimentStarted(channel);
+            started.push_back(channel);
+        }
+        if (started.empty())
+            return;
+
+        // one thread blocks on the first channel alone
+        uint8_t first = started.front();
+        threads.emplace_back([notifier, first]() {
+            bool stopped = notifier->waitForExperimentStopped(first, std::chrono::minutes(2));
+            qDebug() << "Channel" << first << (stopped ? "finished" : "did not finish in time");
+        });
+
+        // another waits on every channel at once and ends the application when all are idle
+        threads.emplace_back([notifier, started]() {
+            orchestrate(*notifier, started);
+            QMetaObject::invokeMethod(QCoreApplication::instance(), "quit", Qt::QueuedConnection);
+        });
+    });
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << "Error: " << error.message();
+        return 0;
+    }
+
+    int result = a.exec();
+    for (std::thread& thread : threads)
+        thread.join();
+    return result;
+}
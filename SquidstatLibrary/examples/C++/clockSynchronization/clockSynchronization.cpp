@@ -0,0 +1,306 @@
+/**
+ * \example clockSynchronization.cpp
+ * This example shows how to put the samples of several instruments, and of sensors timed by the host, on one UTC time
+ * base, by following the offset and the drift between the clock of each instrument and the clock of the host.
+ *
+ * AisInstrumentHandler::getExperimentUTCStartTime anchors the timestamps of an experiment once, at its start; after
+ * that, the clocks of the instrument and the host drift apart. `ClockSynchronizer` treats every sample as a timestamp
+ * exchange: the instrument time at which it was taken against the host time at which it arrived. The difference is the
+ * clock offset plus the transfer delay, and the smallest difference within a window of a few seconds is the one with the
+ * least delay. A line fitted through the minima of the last windows gives the offset and the drift of the instrument
+ * clock, and ClockSynchronizer::toUtc applies that line to any sample. From ClockSynchronizer::MinRobustWindows windows
+ * on, windows in which every sample was delayed are left out of the fit. Every experiment has its own start time as
+ * anchor, so the line is fitted per channel and starts over with every new experiment.
+ *
+ * The corrected times include the smallest transfer delay, which is about the same for instruments on the same kind of
+ * connection, so instruments line up with each other and with the host clock up to the difference of those delays.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantPotElement.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
+
+/**
+ * The relation between the clock of an instrument and the clock of the host.
+ */
+struct ClockEstimate {
+    double offset = 0; ///< host time minus instrument time in seconds, at the latest window.
+    double drift = 0; ///< how fast the offset changes, in parts per million.
+    double residual = 0; ///< the root mean square distance of the window minima from the fitted line, in seconds.
+    int windows = 0; ///< the windows the estimate is based on; 0 until the first window is complete.
+};
+
+/**
+ * Estimates the clock offset and drift of every running channel of the added instruments from the timestamps of its samples.
+ */
+class ClockSynchronizer {
+public:
+    static constexpr int MinRobustWindows = 5; ///< the windows it takes before delayed windows are left out of the fit.
+
+    /**
+     * @param windowLength the seconds of host time over which the sample with the least delay is taken.
+     * @param windowCount the number of windows the line is fitted through.
+     */
+    explicit ClockSynchronizer(double windowLength = 10, int windowCount = 30)
+        : m_windowLength(windowLength)
+        , m_windowCount(windowCount)
+        , m_utcAnchor(QDateTime::currentMSecsSinceEpoch() / 1000.0)
+    {
+        m_hostClock.start();
+    }
+
+    /**
+     * @brief the host time in seconds since the Unix Epoch. It never steps, even when the system clock is adjusted, so
+     * use it to time the readings of other sensors that should line up with the instruments.
+     */
+    double hostUtcNow() const { return m_utcAnchor + m_hostClock.nsecsElapsed() * 1e-9; }
+
+    void addDevice(const QString& deviceName, const AisInstrumentHandler& handler)
+    {
+        const AisInstrumentHandler* source = &handler;
+        QObject::connect(source, &AisInstrumentHandler::activeDCDataReady, [=](uint8_t channel, const AisDCData& data) {
+            observe(deviceName, *source, channel, data.timestamp);
+        });
+        QObject::connect(source, &AisInstrumentHandler::activeACDataReady, [=](uint8_t channel, const AisACData& data) {
+            observe(deviceName, *source, channel, data.timestamp);
+        });
+        QObject::connect(source, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString&) {
+            // the next experiment has a new anchor, so its fit starts over
+            m_channels.erase({ deviceName, channel });
+        });
+    }
+
+    ClockEstimate estimate(const QString& deviceName, uint8_t channel) const
+    {
+        auto found = m_channels.find({ deviceName, channel });
+        return found != m_channels.end() ? found->second.estimate : ClockEstimate();
+    }
+
+    /**
+     * @brief the host UTC time, in seconds since the Unix Epoch, at which a sample was taken.
+     * @param timestamp the timestamp of the sample, in seconds since the start of the experiment on the channel.
+     * @return nothing if no sample of the running experiment on the channel has arrived yet, since its start is unknown.
+     */
+    std::optional<double> toUtc(const QString& deviceName, uint8_t channel, double timestamp) const
+    {
+        auto found = m_channels.find({ deviceName, channel });
+        if (found == m_channels.end())
+            return std::nullopt;
+        const Channel& state = found->second;
+        double instrumentTime = state.start + timestamp;
+        return instrumentTime + state.offsetAt(instrumentTime);
+    }
+
+private:
+    struct Window {
+        double instrumentTime; ///< of the sample with the least delay.
+        double offset; ///< host time minus instrument time of that sample.
+    };
+
+    struct Channel {
+        double start = 0; ///< the UTC start time of the experiment, the anchor of its timestamps.
+        double windowEnd = 0; ///< in host time.
+        bool windowOpen = false;
+        Window current {};
+        std::deque<Window> windows;
+        double reference = 0; ///< the instrument time the fitted line is centred on, to keep the fit precise.
+        double intercept = 0;
+        double slope = 0;
+        ClockEstimate estimate;
+
+        double offsetAt(double instrumentTime) const
+        {
+            if (windows.empty())
+                return windowOpen ? current.offset : 0;
+            return intercept + slope * (instrumentTime - reference);
+        }
+    };
+
+    void observe(const QString& deviceName, const AisInstrumentHandler& handler, uint8_t channel, double timestamp)
+    {
+        double host = hostUtcNow();
+        auto found = m_channels.find({ deviceName, channel });
+        if (found == m_channels.end()) {
+            found = m_channels.emplace(std::make_pair(deviceName, channel), Channel()).first;
+            found->second.start = handler.getExperimentUTCStartTime(channel);
+        }
+        Channel& state = found->second;
+        double instrumentTime = state.start + timestamp;
+        double offset = host - instrumentTime;
+
+        if (state.windowOpen && host >= state.windowEnd) {
+            state.windows.push_back(state.current);
+            if (static_cast<int>(state.windows.size()) > m_windowCount)
+                state.windows.pop_front();
+            fit(state);
+            state.windowOpen = false;
+        }
+        if (!state.windowOpen) {
+            state.current = { instrumentTime, offset };
+            state.windowEnd = host + m_windowLength;
+            state.windowOpen = true;
+        } else if (offset < state.current.offset) {
+            state.current = { instrumentTime, offset };
+        }
+    }
+
+    // fits offset = intercept + slope * (time - reference) by least squares, then once more without the minima far above
+    // the line, since a window in which every sample was delayed does not show the clock offset. "Far" is measured from
+    // a Theil-Sen line, with the median absolute deviation of the distances to it, which a few delayed windows hardly
+    // move, even at the ends of the line; a bound on the RMS of the least squares residuals could reject nothing below
+    // ten windows, as the largest of n residuals is at most sqrt(n - 1) times their RMS.
+    static void fit(Channel& state)
+    {
+        std::vector<Window> points(state.windows.begin(), state.windows.end());
+        for (int pass = 0; pass < 2; ++pass) {
+            double reference = 0;
+            for (const Window& point : points)
+                reference += point.instrumentTime / points.size();
+
+            double meanX = 0, meanY = 0;
+            for (const Window& point : points) {
+                meanX += (point.instrumentTime - reference) / points.size();
+                meanY += point.offset / points.size();
+            }
+            double sxx = 0, sxy = 0;
+            for (const Window& point : points) {
+                double x = point.instrumentTime - reference - meanX;
+                sxx += x * x;
+                sxy += x * (point.offset - meanY);
+            }
+            state.reference = reference;
+            state.slope = sxx > 0 ? sxy / sxx : 0;
+            state.intercept = meanY - state.slope * meanX;
+
+            std::vector<double> residuals;
+            for (const Window& point : points)
+                residuals.push_back(point.offset - state.offsetAt(point.instrumentTime));
+            double squares = 0;
+            for (double residual : residuals)
+                squares += residual * residual;
+            double rms = std::sqrt(squares / points.size());
+
+            state.estimate.residual = rms;
+            state.estimate.windows = static_cast<int>(points.size());
+            if (pass == 1 || static_cast<int>(points.size()) < MinRobustWindows)
+                break;
+            std::vector<double> slopes;
+            for (size_t i = 0; i < points.size(); ++i) {
+                for (size_t j = i + 1; j < points.size(); ++j) {
+                    if (points[j].instrumentTime != points[i].instrumentTime)
+                        slopes.push_back((points[j].offset - points[i].offset) / (points[j].instrumentTime - points[i].instrumentTime));
+                }
+            }
+            double robustSlope = slopes.empty() ? 0 : medianOf(slopes);
+            std::vector<double> distances;
+            for (const Window& point : points)
+                distances.push_back(point.offset - robustSlope * (point.instrumentTime - reference));
+            double median = medianOf(distances);
+            std::vector<double> deviations;
+            for (double distance : distances)
+                deviations.push_back(std::fabs(distance - median));
+            // 1.4826 times the median absolute deviation estimates the standard deviation of normal noise
+            double spread = 1.4826 * medianOf(deviations);
+            std::vector<Window> kept;
+            for (size_t i = 0; i < points.size(); ++i) {
+                // only delays push a minimum up, so only the minima above the line are left out
+                if (distances[i] - median <= 3 * spread)
+                    kept.push_back(points[i]);
+            }
+            if (spread == 0 || kept.size() == points.size() || kept.size() < 2)
+                break;
+            points = kept;
+        }
+        state.estimate.offset = state.offsetAt(state.windows.back().instrumentTime);
+        state.estimate.drift = state.slope * 1e6;
+    }
+
+    static double medianOf(std::vector<double> values)
+    {
+        size_t middle = values.size() / 2;
+        std::nth_element(values.begin(), values.begin() + middle, values.end());
+        if (values.size() % 2 == 1)
+            return values[middle];
+        return (values[middle] + *std::max_element(values.begin(), values.begin() + middle)) / 2;
+    }
+
+    double m_windowLength;
+    int m_windowCount;
+    double m_utcAnchor;
+    QElapsedTimer m_hostClock;
+    std::map<std::pair<QString, uint8_t>, Channel> m_channels;
+};
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+    auto synchronizer = std::make_shared<ClockSynchronizer>();
+    auto channels = std::make_shared<std::vector<std::pair<QString, uint8_t>>>();
+
+    // hold the open circuit potential, sampled every 100ms, for an hour on the first free channel of every instrument
+    AisConstantPotElement cvElement(0, 0.1, 3600);
+    cvElement.setVoltageVsOCP(true);
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendElement(cvElement, 1);
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        synchronizer->addDevice(deviceName, handler);
+
+        // every 100th sample of the instrument on the common time base
+        auto count = std::make_shared<int>(0);
+        QObject::connect(&handler, &AisInstrumentHandler::activeDCDataReady, [=](uint8_t channel, const AisDCData& data) {
+            std::optional<double> time = synchronizer->toUtc(deviceName, channel, data.timestamp);
+            if (++*count % 100 == 0 && time)
+                qDebug() << deviceName << "channel" << channel << "sample at" << QString::number(*time, 'f', 6);
+        });
+
+        std::vector<uint8_t> freeChannels = handler.getFreeChannels();
+        if (freeChannels.empty())
+            return;
+        auto error = handler.uploadExperimentToChannel(freeChannels.front(), experiment);
+        if (!error)
+            error = handler.startUploadedExperiment(freeChannels.front());
+        if (error) {
+            qDebug() << deviceName << ":" << error.message();
+            return;
+        }
+        channels->push_back({ deviceName, freeChannels.front() });
+    });
+
+    // report the clock of every instrument every 30 seconds
+    QTimer reportTimer;
+    QObject::connect(&reportTimer, &QTimer::timeout, &a, [=]() {
+        for (const auto& channel : *channels) {
+            ClockEstimate estimate = synchronizer->estimate(channel.first, channel.second);
+            qDebug() << channel.first << ": offset" << estimate.offset * 1e3 << "ms, drift" << estimate.drift << "ppm, residual" << estimate.residual * 1e3 << "ms over" << estimate.windows << "windows";
+        }
+    });
+    reportTimer.start(30000);
+
+    if (tracker->connectAllPluggedInDevices() == 0) {
+        qDebug() << "Error: no device found";
+        return 0;
+    }
+
+    return a.exec();
+}
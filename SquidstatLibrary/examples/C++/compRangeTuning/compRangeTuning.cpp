@@ -0,0 +1,246 @@
+/**
+ * \example compRangeTuning.cpp
+ * This example shows how to pick the `AisCompRange` of every channel automatically instead of by trial and error.
+ *
+ * Each candidate pair of bandwidth index and stability factor is applied with AisInstrumentHandler::setCompRange and
+ * tested with a short probe: a rest at open circuit followed by a small potential step. A stable potentiostat answers
+ * the step with a current that decays monotonically, so the response is scored by how much its total variation exceeds
+ * its range. Both ringing and noise raise that score, while a clean decay scores zero. A candidate that makes the
+ * channel report a device error is rejected. Once every candidate has been probed the best one is applied.
+ *
+ * Every channel of the device works through its own list of candidates, so all channels are tuned concurrently.
+ */
+#include "AisCompRange.h"
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantPotElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+
+/**
+ * A compensation range candidate and the score of its probe.
+ */
+struct CompRangeCandidate {
+    uint8_t bandwidthIndex;
+    uint8_t stabilityFactor;
+    double score; ///< lower is better, infinity when the probe failed or has not run.
+};
+
+/**
+ * Works through the compensation range candidates of one channel and scores the probe of each.
+ */
+class CompRangeTuner {
+public:
+    /**
+     * @param indexStep the spacing of the candidate grid over both the bandwidth index and the stability factor (0-10).
+     * @param tolerance scores within this fraction of the best are considered equal, and the fastest of them wins.
+     */
+    explicit CompRangeTuner(uint8_t indexStep = 2, double tolerance = 0.1)
+        : m_tolerance(tolerance)
+    {
+        for (int bandwidth = 0; bandwidth <= 10; bandwidth += std::max<uint8_t>(indexStep, 1)) {
+            for (int stability = 0; stability <= 10; stability += std::max<uint8_t>(indexStep, 1))
+                m_candidates.push_back({ static_cast<uint8_t>(bandwidth), static_cast<uint8_t>(stability), Unscored });
+        }
+    }
+
+    bool finished() const { return m_current >= m_candidates.size(); }
+
+    size_t probedCount() const { return m_current; }
+
+    const std::vector<CompRangeCandidate>& candidates() const { return m_candidates; }
+
+    /**
+     * @brief the compensation range to probe next.
+     */
+    AisCompRange currentCompRange() const
+    {
+        const CompRangeCandidate& candidate = m_candidates[m_current];
+        return AisCompRange(QString("tuning %1/%2").arg(candidate.bandwidthIndex).arg(candidate.stabilityFactor), candidate.bandwidthIndex, candidate.stabilityFactor);
+    }
+
+    /**
+     * @brief discards the samples so far. Call this when a new element of the probe starts, so only the last one is scored.
+     */
+    void beginElement() { m_currents.clear(); }
+
+    void addSample(const AisDCData& data) { m_currents.push_back(data.current); }
+
+    void reportError() { m_failed = true; }
+
+    /**
+     * @brief scores the probe of the current candidate and moves on to the next one.
+     * @return the score of the probe.
+     */
+    double finishProbe()
+    {
+        double score = m_failed ? Unscored : roughness(m_currents);
+        m_candidates[m_current++].score = score;
+        m_currents.clear();
+        m_failed = false;
+        return score;
+    }
+
+    /**
+     * @brief the best candidate probed so far: the highest bandwidth, then the lowest stability factor, among the
+     * candidates that score within the tolerance of the lowest score.
+     * @return nullptr if no probe has succeeded.
+     */
+    const CompRangeCandidate* best() const
+    {
+        double lowest = Unscored;
+        for (const CompRangeCandidate& candidate : m_candidates)
+            lowest = std::min(lowest, candidate.score);
+        if (!(lowest < Unscored))
+            return nullptr;
+
+        // an ideal probe scores zero, so the tolerance also needs an absolute part
+        double limit = lowest * (1 + m_tolerance) + 1e-3;
+        const CompRangeCandidate* result = nullptr;
+        for (const CompRangeCandidate& candidate : m_candidates) {
+            if (candidate.score > limit)
+                continue;
+            if (!result || candidate.bandwidthIndex > result->bandwidthIndex
+                || (candidate.bandwidthIndex == result->bandwidthIndex && candidate.stabilityFactor < result->stabilityFactor))
+                result = &candidate;
+        }
+        return result;
+    }
+
+    /**
+     * @brief how far the total variation of a response exceeds its range, relative to that range.
+     *
+     * This is zero for a monotonic response and grows with every extra swing, whether from ringing or from noise.
+     */
+    static double roughness(const std::vector<double>& currents)
+    {
+        if (currents.size() < 4)
+            return Unscored;
+
+        double totalVariation = 0;
+        double minimum = currents.front();
+        double maximum = currents.front();
+        for (size_t i = 1; i < currents.size(); ++i) {
+            totalVariation += std::fabs(currents[i] - currents[i - 1]);
+            minimum = std::min(minimum, currents[i]);
+            maximum = std::max(maximum, currents[i]);
+        }
+
+        double range = maximum - minimum;
+        if (range <= 0)
+            return Unscored;
+        return (totalVariation - range) / range;
+    }
+
+private:
+    static constexpr double Unscored = std::numeric_limits<double>::infinity();
+
+    double m_tolerance;
+    std::vector<CompRangeCandidate> m_candidates;
+    size_t m_current = 0;
+    std::vector<double> m_currents;
+    bool m_failed = false;
+};
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // the probe: 0.1s at open circuit, then a 10mV step held for 0.4s, both sampled every millisecond
+    AisConstantPotElement restElement(0, 0.001, 0.1);
+    restElement.setVoltageVsOCP(true);
+    AisConstantPotElement stepElement(0.01, 0.001, 0.4);
+    stepElement.setVoltageVsOCP(true);
+    auto probe = std::make_shared<AisExperiment>();
+    probe->appendElement(restElement, 1);
+    probe->appendElement(stepElement, 1);
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        auto tuners = std::make_shared<std::vector<CompRangeTuner>>(std::max(0, handler.getNumberOfChannels()));
+        // only the channels that were free when the device connected are tuned
+        auto tuning = std::make_shared<std::vector<bool>>(tuners->size(), false);
+
+        // applies the current candidate of a channel and starts its probe, or applies the best candidate when all are done
+        auto runNext = [=, &handler](uint8_t channel) {
+            CompRangeTuner& tuner = (*tuners)[channel];
+            (*tuning)[channel] = true;
+            while (!tuner.finished()) {
+                auto error = handler.setCompRange(channel, tuner.currentCompRange());
+                if (!error)
+                    error = handler.uploadExperimentToChannel(channel, probe);
+                if (!error)
+                    error = handler.startUploadedExperiment(channel);
+                if (!error)
+                    return;
+                qDebug() << "Channel" << channel << ":" << error.message();
+                tuner.reportError();
+                tuner.finishProbe();
+            }
+
+            (*tuning)[channel] = false;
+            const CompRangeCandidate* best = tuner.best();
+            if (!best) {
+                qDebug() << "Channel" << channel << ": no stable compensation range found";
+                return;
+            }
+            auto error = handler.setCompRange(channel, AisCompRange("tuned", best->bandwidthIndex, best->stabilityFactor));
+            if (error) {
+                qDebug() << "Channel" << channel << ":" << error.message();
+                return;
+            }
+            qDebug() << "Channel" << channel << ": bandwidth index" << best->bandwidthIndex << "stability factor" << best->stabilityFactor
+                     << "score" << best->score;
+        };
+
+        QObject::connect(&handler, &AisInstrumentHandler::experimentNewElementStarting, [=](uint8_t channel, const AisExperimentNode& info) {
+            if (channel < tuners->size())
+                (*tuners)[channel].beginElement();
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::activeDCDataReady, [=](uint8_t channel, const AisDCData& data) {
+            if (channel < tuners->size())
+                (*tuners)[channel].addSample(data);
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::deviceError, [=](uint8_t channel, const QString& error) {
+            qDebug() << "Channel" << channel << "device error:" << error;
+            if (channel < tuners->size())
+                (*tuners)[channel].reportError();
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString& reason) {
+            if (channel >= tuning->size() || !(*tuning)[channel])
+                return;
+            CompRangeTuner& tuner = (*tuners)[channel];
+            double score = tuner.finishProbe();
+            qDebug() << "Channel" << channel << "probe" << tuner.probedCount() << "of" << tuner.candidates().size() << "score" << score << reason;
+            runNext(channel);
+        });
+
+        for (uint8_t channel : handler.getFreeChannels()) {
+            if (channel < tuners->size())
+                runNext(channel);
+        }
+    });
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << "Error: " << error.message();
+        return 0;
+    }
+
+    return a.exec();
+}
@@ -0,0 +1,295 @@
+/**
+ * \example compactSamples.cpp
+ * This example shows how to store and pass on DC data for long monitoring runs at half the size of `AisDCData`.
+ *
+ * `AisDCData` holds five doubles, 40 bytes per sample. A `CompactDCBatch` holds the samples of one channel as:
+ * - one 64 bit timestamp in microsecond ticks for the batch, and a 32 bit tick offset per sample,
+ * - the voltages, the current and the temperature as 32 bit floats, which keep about seven significant digits.
+ * That is 20 bytes per sample. Samples are converted back to `AisDCData` on demand with CompactDCBatch::at.
+ *
+ * `CompactSampleCollector` gathers the samples of each channel into batches and hands over a batch when it is full or
+ * a second old, so the consumers get one call per batch instead of one per sample. Here the batches are appended to an
+ * archive file, which is read back at the end to report its size and the largest error of the conversion. Only a
+ * bounded sample of the original data is kept for that report, so the memory use of a long run does not grow.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantPotElement.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTimer>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <vector>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+#define CHANNEL 0
+#define ARCHIVE_FILE "squidstat.dca"
+#define ERROR_SAMPLE_STRIDE 100
+#define ERROR_SAMPLE_SIZE 10000
+
+/**
+ * One sample in a `CompactDCBatch`.
+ */
+struct CompactDCSample {
+    uint32_t tickOffset; ///< the time since the start of the batch, in ticks.
+    float workingElectrodeVoltage;
+    float counterElectrodeVoltage;
+    float current;
+    float temperature;
+};
+static_assert(sizeof(CompactDCSample) == 20, "a compact sample should take half the size of AisDCData");
+
+/**
+ * The DC samples of one channel, with a shared time base and single precision values.
+ */
+class CompactDCBatch {
+public:
+    static constexpr double TickPeriod = 1e-6; ///< in seconds.
+
+    CompactDCBatch(uint8_t channel = 0, int64_t baseTicks = 0)
+        : m_channel(channel)
+        , m_baseTicks(baseTicks)
+    {
+    }
+
+    static int64_t toTicks(double seconds) { return std::llround(seconds / TickPeriod); }
+
+    /**
+     * @brief adds a sample.
+     * @return false if the sample is before the start of the batch, or too far after it for a 32 bit tick offset
+     * (about 71 minutes); it belongs in a new batch then.
+     */
+    bool append(const AisDCData& data)
+    {
+        int64_t offset = toTicks(data.timestamp) - m_baseTicks;
+        if (offset < 0 || offset > UINT32_MAX)
+            return false;
+        m_samples.push_back({ static_cast<uint32_t>(offset), static_cast<float>(data.workingElectrodeVoltage), static_cast<float>(data.counterElectrodeVoltage),
+            static_cast<float>(data.current), static_cast<float>(data.temperature) });
+        return true;
+    }
+
+    /**
+     * @brief the sample at the index, converted back to `AisDCData`.
+     */
+    AisDCData at(size_t index) const
+    {
+        const CompactDCSample& sample = m_samples[index];
+        return { (m_baseTicks + sample.tickOffset) * TickPeriod, sample.workingElectrodeVoltage, sample.counterElectrodeVoltage, sample.current, sample.temperature };
+    }
+
+    uint8_t channel() const { return m_channel; }
+    int64_t baseTicks() const { return m_baseTicks; }
+    size_t size() const { return m_samples.size(); }
+    bool isEmpty() const { return m_samples.empty(); }
+    void reserve(size_t count) { m_samples.reserve(count); }
+
+    friend QDataStream& operator<<(QDataStream& out, const CompactDCBatch& batch)
+    {
+        out << batch.m_channel << static_cast<qint64>(batch.m_baseTicks) << static_cast<quint32>(batch.m_samples.size());
+        for (const CompactDCSample& sample : batch.m_samples)
+            out << sample.tickOffset << sample.workingElectrodeVoltage << sample.counterElectrodeVoltage << sample.current << sample.temperature;
+        return out;
+    }
+
+    friend QDataStream& operator>>(QDataStream& in, CompactDCBatch& batch)
+    {
+        qint64 baseTicks;
+        quint32 count;
+        in >> batch.m_channel >> baseTicks >> count;
+        batch.m_baseTicks = baseTicks;
+        batch.m_samples.clear();
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+            CompactDCSample sample;
+            in >> sample.tickOffset >> sample.workingElectrodeVoltage >> sample.counterElectrodeVoltage >> sample.current >> sample.temperature;
+            batch.m_samples.push_back(sample);
+        }
+        return in;
+    }
+
+private:
+    uint8_t m_channel;
+    int64_t m_baseTicks;
+    std::vector<CompactDCSample> m_samples;
+};
+
+/**
+ * Gathers the DC samples of every channel into batches, and hands over each batch when it is full or old enough.
+ */
+class CompactSampleCollector {
+public:
+    using BatchReady = std::function<void(const CompactDCBatch&)>;
+
+    /**
+     * @param batchSize the number of samples in a full batch.
+     * @param maximumAge the time in milliseconds after which a batch is handed over even if it is not full.
+     */
+    CompactSampleCollector(BatchReady batchReady, size_t batchSize = 1000, int maximumAge = 1000)
+        : m_batchReady(std::move(batchReady))
+        , m_batchSize(batchSize)
+        , m_maximumAge(maximumAge)
+    {
+        // checking a few times per maximum age hands a batch over at most a quarter of that age late
+        m_clock.start();
+        m_timer.setInterval(std::max(1, maximumAge / 4));
+        QObject::connect(&m_timer, &QTimer::timeout, [this]() { flushOlderThan(m_maximumAge); });
+        m_timer.start();
+    }
+
+    void add(uint8_t channel, const AisDCData& data)
+    {
+        auto found = m_batches.find(channel);
+        if (found != m_batches.end() && !found->second.batch.append(data)) {
+            // the sample does not fit the time base of the current batch, so it starts a new one
+            m_batchReady(found->second.batch);
+            m_batches.erase(found);
+            found = m_batches.end();
+        }
+        if (found == m_batches.end()) {
+            found = m_batches.emplace(channel, PendingBatch { CompactDCBatch(channel, CompactDCBatch::toTicks(data.timestamp)), m_clock.elapsed() }).first;
+            found->second.batch.reserve(m_batchSize);
+            found->second.batch.append(data);
+        }
+        if (found->second.batch.size() >= m_batchSize) {
+            m_batchReady(found->second.batch);
+            m_batches.erase(found);
+        }
+    }
+
+    /**
+     * @brief hands over the samples of all channels that are not handed over yet.
+     */
+    void flush() { flushOlderThan(-1); }
+
+private:
+    struct PendingBatch {
+        CompactDCBatch batch;
+        qint64 created; ///< in milliseconds of m_clock.
+    };
+
+    void flushOlderThan(qint64 age)
+    {
+        qint64 now = m_clock.elapsed();
+        for (auto it = m_batches.begin(); it != m_batches.end();) {
+            if (now - it->second.created <= age) {
+                ++it;
+                continue;
+            }
+            m_batchReady(it->second.batch);
+            it = m_batches.erase(it);
+        }
+    }
+
+    BatchReady m_batchReady;
+    size_t m_batchSize;
+    qint64 m_maximumAge;
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+    std::map<uint8_t, PendingBatch> m_batches;
+};
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // hold 0.1V for 10 minutes, sampled every millisecond
+    AisConstantPotElement cvElement(0.1, 0.001, 600);
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendElement(cvElement, 1);
+
+    auto archive = std::make_shared<QFile>(ARCHIVE_FILE);
+    if (!archive->open(QIODevice::WriteOnly)) {
+        qDebug() << "Could not open" << ARCHIVE_FILE;
+        return 0;
+    }
+    auto stream = std::make_shared<QDataStream>(archive.get());
+    stream->setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    // every 100th original, up to 10000 of them, is kept to report the error of the conversion at the end
+    auto originals = std::make_shared<std::vector<AisDCData>>();
+    originals->reserve(ERROR_SAMPLE_SIZE);
+    auto received = std::make_shared<size_t>(0);
+    auto collector = std::make_shared<CompactSampleCollector>([=](const CompactDCBatch& batch) {
+        *stream << batch;
+    });
+
+    auto report = [=]() {
+        archive->close();
+        QFile file(ARCHIVE_FILE);
+        if (!file.open(QIODevice::ReadOnly))
+            return;
+        QDataStream in(&file);
+        in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+        size_t count = 0;
+        double timeError = 0, voltageError = 0, currentError = 0;
+        while (!in.atEnd() && in.status() == QDataStream::Ok) {
+            CompactDCBatch batch;
+            in >> batch;
+            for (size_t i = 0; i < batch.size(); ++i, ++count) {
+                if (count % ERROR_SAMPLE_STRIDE != 0 || count / ERROR_SAMPLE_STRIDE >= originals->size())
+                    continue;
+                AisDCData sample = batch.at(i);
+                const AisDCData& original = (*originals)[count / ERROR_SAMPLE_STRIDE];
+                timeError = std::max(timeError, std::fabs(sample.timestamp - original.timestamp));
+                voltageError = std::max(voltageError, std::fabs(sample.workingElectrodeVoltage - original.workingElectrodeVoltage));
+                if (original.current != 0)
+                    currentError = std::max(currentError, std::fabs(sample.current / original.current - 1));
+            }
+        }
+        qDebug() << count << "samples in" << file.size() << "bytes, against" << count * sizeof(AisDCData) << "bytes as AisDCData";
+        qDebug() << "Largest error over" << originals->size() << "samples: time" << timeError << "s, working electrode voltage" << voltageError << "V, relative current" << currentError;
+    };
+
+    auto connectSignals = [=](const AisInstrumentHandler& handler) {
+        QObject::connect(&handler, &AisInstrumentHandler::activeDCDataReady, [=](uint8_t channel, const AisDCData& data) {
+            if ((*received)++ % ERROR_SAMPLE_STRIDE == 0 && originals->size() < ERROR_SAMPLE_SIZE)
+                originals->push_back(data);
+            collector->add(channel, data);
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString& reason) {
+            qDebug() << "Experiment Stopped Signal " << channel << "Reason : " << reason;
+            collector->flush();
+            report();
+            QCoreApplication::quit();
+        });
+    };
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        connectSignals(handler);
+
+        auto error = handler.uploadExperimentToChannel(CHANNEL, experiment);
+        if (error) {
+            qDebug() << error.message();
+            return;
+        }
+        error = handler.startUploadedExperiment(CHANNEL);
+        if (error) {
+            qDebug() << error.message();
+        }
+    });
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << "Error: " << error.message();
+        return 0;
+    }
+
+    return a.exec();
+}
@@ -0,0 +1,236 @@
+/**
+ * \example compactStepNodes.cpp
+ * This example shows how to follow the element transitions of long cycling protocols without copying a step name for
+ * every transition.
+ *
+ * AisInstrumentHandler::experimentNewElementStarting passes an `AisExperimentNode` that holds the step name as a
+ * QString. Queuing the node to another thread copies it, and every further copy of the name touches its shared
+ * reference count, for every one of the tens of thousands of transitions of a protocol of short repeated elements.
+ *
+ * Here, the names of the elements of each uploaded experiment are interned in a `StepNameTable` before the upload. The
+ * node is turned into a `CompactExperimentNode` straight in the slot, where the name is only looked up, and that compact
+ * node is what travels on: a plain 16 byte struct, passed through a lock-free ring to a worker thread. The worker looks
+ * a name up from its handle only when it needs the text.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantCurrentElement.h"
+#include "experiments/builder_elements/AisOpenCircuitElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QHash>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+#define CHANNEL 0
+
+/**
+ * The step names of an experiment, each stored once and referred to by a handle.
+ */
+class StepNameTable {
+public:
+    static constexpr uint16_t UnknownName = 0xFFFF;
+
+    /**
+     * @brief adds the name of an element, before the experiment that holds it is uploaded.
+     */
+    void preload(const AisAbstractElement& element) { intern(element.getName()); }
+
+    /**
+     * @brief the handle of a name, adding the name if it is new.
+     * @note once all names are preloaded this only looks names up, and does not allocate.
+     */
+    uint16_t intern(const QString& name)
+    {
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            auto found = m_handles.constFind(name);
+            if (found != m_handles.constEnd())
+                return found.value();
+        }
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        auto found = m_handles.constFind(name);
+        if (found != m_handles.constEnd())
+            return found.value();
+        if (m_names.size() >= UnknownName)
+            return UnknownName;
+        uint16_t handle = static_cast<uint16_t>(m_names.size());
+        m_names.push_back(name);
+        m_handles.insert(name, handle);
+        return handle;
+    }
+
+    /**
+     * @brief the name of a handle, or an empty string for an unknown handle.
+     */
+    QString name(uint16_t handle) const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        return handle < m_names.size() ? m_names[handle] : QString();
+    }
+
+    size_t size() const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        return m_names.size();
+    }
+
+private:
+    mutable std::shared_mutex m_mutex;
+    std::vector<QString> m_names;
+    QHash<QString, uint16_t> m_handles;
+};
+
+/**
+ * An `AisExperimentNode` with the step name replaced by its handle in a `StepNameTable`.
+ */
+struct CompactExperimentNode {
+    int32_t stepNumber;
+    int32_t substepNumber;
+    int32_t cycle;
+    uint16_t name;
+    uint8_t channel;
+};
+static_assert(sizeof(CompactExperimentNode) == 16, "a compact node should stay small");
+static_assert(std::is_trivially_copyable<CompactExperimentNode>::value, "a compact node should copy without allocating");
+
+/**
+ * A ring that passes compact nodes from the thread of the handler to one worker thread, without locks.
+ */
+class NodeRing {
+public:
+    static constexpr size_t Capacity = 4096;
+
+    /**
+     * @return false if the ring is full.
+     */
+    bool push(const CompactExperimentNode& node)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) >= Capacity)
+            return false;
+        m_nodes[head % Capacity] = node;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(CompactExperimentNode& node)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+            return false;
+        node = m_nodes[tail % Capacity];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    alignas(64) std::atomic<size_t> m_head { 0 };
+    alignas(64) std::atomic<size_t> m_tail { 0 };
+    std::array<CompactExperimentNode, Capacity> m_nodes;
+};
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // a cycling protocol of two short elements, repeated 10000 times: 20000 element transitions
+    AisConstantCurrentElement chargeElement(1e-3, 0.1, 1);
+    chargeElement.setMaxVoltage(1.5);
+    AisOpenCircuitElement restElement(1, 0.1);
+    AisExperiment cycle;
+    cycle.appendElement(chargeElement, 1);
+    cycle.appendElement(restElement, 1);
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendSubExperiment(cycle, 10000);
+
+    // the names are interned before the upload, so the slot below only looks them up
+    auto names = std::make_shared<StepNameTable>();
+    names->preload(chargeElement);
+    names->preload(restElement);
+
+    auto ring = std::make_shared<NodeRing>();
+    std::atomic<bool> done { false };
+    std::atomic<uint64_t> overflows { 0 };
+
+    // the worker counts the transitions of each step, and needs the names only for its report
+    std::thread worker([&]() {
+        std::map<uint16_t, uint64_t> transitions;
+        int32_t lastCycle = -1;
+        CompactExperimentNode node;
+        while (true) {
+            // read the flag first: once it is set, a ring found empty stays empty
+            bool finished = done.load();
+            if (!ring->pop(node)) {
+                if (finished)
+                    break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            ++transitions[node.name];
+            if (node.cycle != lastCycle && node.cycle % 1000 == 0)
+                qDebug() << "Cycle" << node.cycle << "started with" << names->name(node.name);
+            lastCycle = node.cycle;
+        }
+        for (const auto& entry : transitions)
+            qDebug() << names->name(entry.first) << ":" << entry.second << "transitions";
+        qDebug() << overflows.load() << "transitions did not fit in the ring";
+    });
+
+    auto connectSignals = [=, &done, &overflows](const AisInstrumentHandler& handler) {
+        QObject::connect(&handler, &AisInstrumentHandler::experimentNewElementStarting, [=, &overflows](uint8_t channel, const AisExperimentNode& node) {
+            CompactExperimentNode compact { node.stepNumber, node.substepNumber, node.cycle, names->intern(node.stepName), channel };
+            if (!ring->push(compact))
+                ++overflows;
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [=, &done](uint8_t channel, const QString& reason) {
+            qDebug() << "Experiment Stopped Signal " << channel << "Reason : " << reason << "," << names->size() << "distinct step names";
+            done = true;
+            QCoreApplication::quit();
+        });
+    };
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        connectSignals(handler);
+
+        auto error = handler.uploadExperimentToChannel(CHANNEL, experiment);
+        if (error) {
+            qDebug() << error.message();
+            return;
+        }
+        error = handler.startUploadedExperiment(CHANNEL);
+        if (error) {
+            qDebug() << error.message();
+        }
+    });
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    int result = 0;
+    if (error) {
+        qDebug() << "Error: " << error.message();
+    } else {
+        result = a.exec();
+    }
+
+    done = true;
+    worker.join();
+    return result;
+}
@@ -0,0 +1,366 @@
+/**
+ * \example conditionTriggers.cpp
+ * This example shows how to end, stop or pause an experiment on a condition of the measured data with as little latency as possible.
+ *
+ * Triggers are declared up front as a quantity (current, voltage, charge, current slope or time since the step started),
+ * a comparison against a threshold and an action. They are handled in two tiers:
+ * - A trigger that only ends the running element and that the element supports as an ending condition, for example
+ *   a minimum absolute current on an `AisConstantPotElement`, is compiled into that element. The instrument then
+ *   evaluates it on its own timebase and no command has to be sent at all.
+ * - Every other trigger is evaluated on the host for each sample. The slot is connected without a context object, so Qt
+ *   calls it directly when the handler emits AisInstrumentHandler::activeDCDataReady on the thread of the event loop,
+ *   and the action is sent from there without another trip through the event loop.
+ *
+ * For every host trigger the latency is reported: how long the command took, how long until the instrument
+ * confirmed the action and how many samples arrived in between.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantCurrentElement.h"
+#include "experiments/builder_elements/AisConstantPotElement.h"
+#include "experiments/builder_elements/AisOpenCircuitElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+#define CHANNEL 0
+
+enum class TriggerQuantity {
+    Current, ///< the absolute current in Amps.
+    Voltage, ///< the working electrode voltage in volts.
+    Charge, ///< the absolute charge passed since the step started in Coulombs.
+    CurrentSlope, ///< the absolute rate of change of the current in Amps per second.
+    TimeSinceStep ///< the time since the first sample of the step in seconds.
+};
+
+enum class TriggerComparison {
+    Above,
+    Below
+};
+
+enum class TriggerAction {
+    SkipStep,
+    Stop,
+    Pause
+};
+
+/**
+ * A declarative condition on the measured data, and what to do when it is met.
+ */
+struct ConditionTrigger {
+    TriggerQuantity quantity;
+    TriggerComparison comparison;
+    double threshold;
+    TriggerAction action;
+};
+
+/**
+ * The latency of one host trigger.
+ */
+struct TriggerLatency {
+    size_t trigger; ///< the index of the trigger in the list given to the evaluator.
+    double sampleTimestamp; ///< the timestamp of the sample that met the condition, in seconds.
+    double commandLatency; ///< the time the action command took, in milliseconds.
+    double responseLatency; ///< the time from receiving the sample to the instrument confirming the action, in milliseconds.
+    int overshootSamples; ///< the number of samples received after the triggering one until the confirmation.
+};
+
+/**
+ * @brief moves the triggers that an `AisConstantPotElement` supports as ending conditions into the element.
+ * @return the triggers that still have to be evaluated on the host.
+ */
+static std::vector<ConditionTrigger> compileTriggers(AisConstantPotElement& element, const std::vector<ConditionTrigger>& triggers)
+{
+    std::vector<ConditionTrigger> hostTriggers;
+    for (const ConditionTrigger& trigger : triggers) {
+        bool above = trigger.comparison == TriggerComparison::Above;
+        if (trigger.action != TriggerAction::SkipStep)
+            hostTriggers.push_back(trigger);
+        else if (trigger.quantity == TriggerQuantity::Current && above)
+            element.setMaxAbsoluteCurrent(std::min(trigger.threshold, element.getMaxAbsoluteCurrent()));
+        else if (trigger.quantity == TriggerQuantity::Current)
+            element.setMinAbsoluteCurrent(std::max(trigger.threshold, element.getMinAbsoluteCurrent()));
+        else if (trigger.quantity == TriggerQuantity::Charge && above)
+            element.setMaxCapacity(std::min(trigger.threshold, element.getMaxCapacity()));
+        else if (trigger.quantity == TriggerQuantity::CurrentSlope && !above)
+            element.setMindIdt(std::max(trigger.threshold, element.getMindIdt()));
+        else if (trigger.quantity == TriggerQuantity::TimeSinceStep && above)
+            element.setMaxDuration(std::min(trigger.threshold, element.getMaxDuration()));
+        else
+            hostTriggers.push_back(trigger);
+    }
+    return hostTriggers;
+}
+
+/**
+ * @brief moves the triggers that an `AisConstantCurrentElement` supports as ending conditions into the element.
+ * @return the triggers that still have to be evaluated on the host.
+ */
+static std::vector<ConditionTrigger> compileTriggers(AisConstantCurrentElement& element, const std::vector<ConditionTrigger>& triggers)
+{
+    std::vector<ConditionTrigger> hostTriggers;
+    for (const ConditionTrigger& trigger : triggers) {
+        bool above = trigger.comparison == TriggerComparison::Above;
+        if (trigger.action != TriggerAction::SkipStep)
+            hostTriggers.push_back(trigger);
+        else if (trigger.quantity == TriggerQuantity::Voltage && above)
+            element.setMaxVoltage(std::min(trigger.threshold, element.getMaxVoltage()));
+        else if (trigger.quantity == TriggerQuantity::Voltage)
+            element.setMinVoltage(std::max(trigger.threshold, element.getMinVoltage()));
+        else if (trigger.quantity == TriggerQuantity::Charge && above)
+            element.setMaxCapacity(std::min(trigger.threshold, element.getMaxCapacity()));
+        else if (trigger.quantity == TriggerQuantity::TimeSinceStep && above)
+            element.setMaxDuration(std::min(trigger.threshold, element.getMaxDuration()));
+        else
+            hostTriggers.push_back(trigger);
+    }
+    return hostTriggers;
+}
+
+/**
+ * Evaluates host triggers on the samples of one channel. Every trigger fires at most once per step.
+ */
+class TriggerEvaluator {
+public:
+    using ActionCallback = std::function<AisErrorCode(TriggerAction)>;
+    using LatencyCallback = std::function<void(const TriggerLatency&)>;
+
+    /**
+     * @param triggers the triggers to evaluate.
+     * @param action sends an action to the instrument.
+     */
+    TriggerEvaluator(std::vector<ConditionTrigger> triggers, ActionCallback action)
+        : m_triggers(std::move(triggers))
+        , m_fired(m_triggers.size(), false)
+        , m_action(std::move(action))
+    {
+    }
+
+    void setLatencyCallback(LatencyCallback callback) { m_latencyCallback = std::move(callback); }
+
+    /**
+     * @brief resets the per step state. Call this whenever a new element starts.
+     */
+    void beginStep()
+    {
+        confirm(TriggerAction::SkipStep);
+        m_stepStarted = false;
+        m_fired.assign(m_triggers.size(), false);
+    }
+
+    /**
+     * @brief completes the latency measurement of a pending stop or pause. Call this when the instrument reports it.
+     */
+    void confirm(TriggerAction action)
+    {
+        if (!m_pending || m_pendingAction != action)
+            return;
+        m_pending = false;
+        m_latency.responseLatency = millisecondsSince(m_sampleReceived);
+        if (m_latencyCallback)
+            m_latencyCallback(m_latency);
+    }
+
+    void addSample(const AisDCData& data)
+    {
+        Clock::time_point received = Clock::now();
+        if (m_pending) {
+            ++m_latency.overshootSamples;
+            return;
+        }
+
+        if (!m_stepStarted) {
+            m_stepStarted = true;
+            m_stepStart = data.timestamp;
+            m_charge = 0;
+            m_historySize = 0;
+        } else {
+            m_charge += 0.5 * (data.current + m_previous.current) * (data.timestamp - m_previous.timestamp);
+        }
+        m_previous = data;
+
+        // the slope is taken over a few samples, so it is not dominated by the noise of two neighbours
+        const AisDCData& oldest = m_history[m_historySize % SlopeWindow];
+        bool slopeValid = m_historySize >= SlopeWindow && data.timestamp > oldest.timestamp;
+        double slope = slopeValid ? (data.current - oldest.current) / (data.timestamp - oldest.timestamp) : 0;
+        m_history[m_historySize++ % SlopeWindow] = data;
+
+        for (size_t i = 0; i < m_triggers.size(); ++i) {
+            const ConditionTrigger& trigger = m_triggers[i];
+            if (m_fired[i] || (trigger.quantity == TriggerQuantity::CurrentSlope && !slopeValid))
+                continue;
+
+            double value = 0;
+            switch (trigger.quantity) {
+            case TriggerQuantity::Current:
+                value = std::fabs(data.current);
+                break;
+            case TriggerQuantity::Voltage:
+                value = data.workingElectrodeVoltage;
+                break;
+            case TriggerQuantity::Charge:
+                value = std::fabs(m_charge);
+                break;
+            case TriggerQuantity::CurrentSlope:
+                value = std::fabs(slope);
+                break;
+            case TriggerQuantity::TimeSinceStep:
+                value = data.timestamp - m_stepStart;
+                break;
+            }
+
+            bool met = trigger.comparison == TriggerComparison::Above ? value > trigger.threshold : value < trigger.threshold;
+            if (met) {
+                fire(i, data, received);
+                return;
+            }
+        }
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr size_t SlopeWindow = 5;
+
+    static double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    void fire(size_t index, const AisDCData& data, Clock::time_point received)
+    {
+        m_fired[index] = true;
+        m_latency = { index, data.timestamp, 0, 0, 0 };
+        m_sampleReceived = received;
+        m_pendingAction = m_triggers[index].action;
+        m_pending = true;
+
+        AisErrorCode error = m_action(m_pendingAction);
+        m_latency.commandLatency = millisecondsSince(received);
+        if (error) {
+            qDebug() << "Trigger" << index << "failed:" << error.message();
+            m_pending = false;
+        }
+    }
+
+    std::vector<ConditionTrigger> m_triggers;
+    std::vector<bool> m_fired;
+    ActionCallback m_action;
+    LatencyCallback m_latencyCallback;
+
+    bool m_stepStarted = false;
+    double m_stepStart = 0;
+    double m_charge = 0;
+    AisDCData m_previous {};
+    AisDCData m_history[SlopeWindow] {};
+    size_t m_historySize = 0;
+
+    bool m_pending = false;
+    TriggerAction m_pendingAction = TriggerAction::SkipStep;
+    Clock::time_point m_sampleReceived;
+    TriggerLatency m_latency {};
+};
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // hold 0.5V for up to 10 minutes sampled every 10ms, charge at 1mA for up to 10 minutes, then rest at open circuit
+    // for a minute
+    AisConstantPotElement holdElement(0.5, 0.01, 600);
+    AisConstantCurrentElement chargeElement(0.001, 0.01, 600);
+    AisOpenCircuitElement restElement(60, 0.1);
+
+    std::vector<ConditionTrigger> triggers = {
+        // compiled into the element: end the hold when the current has decayed below 1uA or 10mC have passed
+        { TriggerQuantity::Current, TriggerComparison::Below, 1e-6, TriggerAction::SkipStep },
+        { TriggerQuantity::Charge, TriggerComparison::Above, 0.01, TriggerAction::SkipStep },
+        // evaluated on the host: pause on a sudden change of the current and stop on an overcurrent
+        { TriggerQuantity::CurrentSlope, TriggerComparison::Above, 0.01, TriggerAction::Pause },
+        { TriggerQuantity::Current, TriggerComparison::Above, 0.05, TriggerAction::Stop },
+    };
+    std::vector<ConditionTrigger> hostTriggers = compileTriggers(holdElement, triggers);
+
+    // compiled into the charge element: end the charge once the voltage has reached 1.2V
+    std::vector<ConditionTrigger> chargeTriggers = {
+        { TriggerQuantity::Voltage, TriggerComparison::Above, 1.2, TriggerAction::SkipStep },
+    };
+    std::vector<ConditionTrigger> chargeHostTriggers = compileTriggers(chargeElement, chargeTriggers);
+    hostTriggers.insert(hostTriggers.end(), chargeHostTriggers.begin(), chargeHostTriggers.end());
+
+    size_t totalTriggers = triggers.size() + chargeTriggers.size();
+    qDebug() << totalTriggers - hostTriggers.size() << "triggers run on the instrument," << hostTriggers.size() << "on the host";
+
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendElement(holdElement, 1);
+    experiment->appendElement(chargeElement, 1);
+    experiment->appendElement(restElement, 1);
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+
+        auto evaluator = std::make_shared<TriggerEvaluator>(hostTriggers, [&handler](TriggerAction action) {
+            if (action == TriggerAction::SkipStep)
+                return handler.skipExperimentStep(CHANNEL);
+            if (action == TriggerAction::Stop)
+                return handler.stopExperiment(CHANNEL);
+            return handler.pauseExperiment(CHANNEL);
+        });
+        evaluator->setLatencyCallback([](const TriggerLatency& latency) {
+            qDebug() << "Trigger" << latency.trigger << "at" << latency.sampleTimestamp << "s: command" << latency.commandLatency << "ms, confirmed after"
+                     << latency.responseLatency << "ms," << latency.overshootSamples << "samples overshoot";
+        });
+
+        // no context object, so these are called directly when the handler emits the signals
+        QObject::connect(&handler, &AisInstrumentHandler::activeDCDataReady, [=](uint8_t channel, const AisDCData& data) {
+            if (channel == CHANNEL)
+                evaluator->addSample(data);
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentNewElementStarting, [=](uint8_t channel, const AisExperimentNode& info) {
+            if (channel != CHANNEL)
+                return;
+            qDebug() << "New element beginning: " << info.stepName << "step: " << info.stepNumber;
+            evaluator->beginStep();
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentPaused, [=](uint8_t channel) {
+            if (channel == CHANNEL)
+                evaluator->confirm(TriggerAction::Pause);
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString& reason) {
+            if (channel != CHANNEL)
+                return;
+            evaluator->confirm(TriggerAction::Stop);
+            qDebug() << "Experiment Stopped Signal " << channel << "Reason : " << reason;
+        });
+
+        auto error = handler.uploadExperimentToChannel(CHANNEL, experiment);
+        if (error) {
+            qDebug() << error.message();
+            return;
+        }
+        error = handler.startUploadedExperiment(CHANNEL);
+        if (error) {
+            qDebug() << error.message();
+        }
+    });
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << "Error: " << error.message();
+        return 0;
+    }
+
+    return a.exec();
+}
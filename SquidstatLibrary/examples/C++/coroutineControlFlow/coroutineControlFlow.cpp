@@ -0,0 +1,417 @@
+/**
+ * \example coroutineControlFlow.cpp
+ * This example shows how to write the control flow of advancedControlFlow.cpp as C++20 coroutines, instead of nested
+ * lambdas, heap allocated timers and a static step counter.
+ *
+ * `AwaitableInstrument` wraps an `AisInstrumentHandler` and turns its signals into awaitable operations:
+ * - `co_await instrument.runExperiment(channel, experiment)` uploads and starts an experiment and resumes when it stops.
+ * - `co_await instrument.nextElement(channel)` resumes when the next element starts, or with nothing when the experiment stops.
+ * - `co_await instrument.dcSamples(channel, n)` resumes with the next n DC samples, or fewer if the experiment stops.
+ * - `co_await instrument.experimentStopped(channel)` resumes when the experiment stops.
+ * - `co_await delay(milliseconds)` resumes after a timeout.
+ *
+ * Coroutines resume from the signals of the handler, on the same event loop that runs the rest of the Qt code, so
+ * no locking is needed. A suspended control flow costs one small heap frame and no thread, so there can be one per
+ * channel for hundreds of channels.
+ *
+ * This example needs C++20.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantCurrentElement.h"
+#include "experiments/builder_elements/AisConstantPotElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QTimer>
+
+#include <algorithm>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+
+/**
+ * A coroutine that runs a control flow. It starts when another control flow awaits it, or when it is detached.
+ */
+class ControlFlow {
+public:
+    struct promise_type {
+        std::coroutine_handle<> continuation;
+        bool detached = false;
+
+        ControlFlow get_return_object() { return ControlFlow(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept
+        {
+            // hands control back to the awaiting control flow, or frees a detached one
+            struct FinalAwaiter {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+                {
+                    promise_type& promise = handle.promise();
+                    if (promise.continuation)
+                        return promise.continuation;
+                    if (promise.detached)
+                        handle.destroy();
+                    return std::noop_coroutine();
+                }
+                void await_resume() noexcept { }
+            };
+            return FinalAwaiter {};
+        }
+        void return_void() { }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    ControlFlow(ControlFlow&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, {}))
+    {
+    }
+
+    ~ControlFlow()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    /**
+     * @brief starts the control flow and lets it free itself when it finishes.
+     */
+    void detach()
+    {
+        auto handle = std::exchange(m_handle, {});
+        handle.promise().detached = true;
+        handle.resume();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        m_handle.promise().continuation = awaiting;
+        return m_handle;
+    }
+    void await_resume() noexcept { }
+
+private:
+    explicit ControlFlow(std::coroutine_handle<promise_type> handle)
+        : m_handle(handle)
+    {
+    }
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+/**
+ * @brief an awaitable that resumes after the given number of milliseconds.
+ */
+inline auto delay(int milliseconds)
+{
+    struct DelayAwaiter {
+        int milliseconds;
+        bool await_ready() const noexcept { return milliseconds <= 0; }
+        void await_suspend(std::coroutine_handle<> handle) { QTimer::singleShot(milliseconds, [handle]() { handle.resume(); }); }
+        void await_resume() const noexcept { }
+    };
+    return DelayAwaiter { milliseconds };
+}
+
+/**
+ * The outcome of an experiment run by a control flow.
+ */
+struct ExperimentResult {
+    AisErrorCode error; ///< the error of the upload or start, AisErrorCode::Success if the experiment ran.
+    QString reason; ///< the reason the experiment stopped, as given by AisInstrumentHandler::experimentStopped.
+};
+
+/**
+ * Turns the signals of an instrument handler into awaitable operations per channel.
+ */
+class AwaitableInstrument {
+public:
+    explicit AwaitableInstrument(const AisInstrumentHandler& handler)
+        : m_handler(handler)
+        , m_channels(std::max(0, handler.getNumberOfChannels()))
+    {
+        m_connections.push_back(QObject::connect(&handler, &AisInstrumentHandler::activeDCDataReady, [this](uint8_t channel, const AisDCData& data) {
+            onSample(channel, data);
+        }));
+        m_connections.push_back(QObject::connect(&handler, &AisInstrumentHandler::experimentNewElementStarting, [this](uint8_t channel, const AisExperimentNode& node) {
+            onNewElement(channel, node);
+        }));
+        m_connections.push_back(QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [this](uint8_t channel, const QString& reason) {
+            onStopped(channel, reason);
+        }));
+    }
+
+    ~AwaitableInstrument()
+    {
+        for (const QMetaObject::Connection& connection : m_connections)
+            QObject::disconnect(connection);
+    }
+
+    AwaitableInstrument(const AwaitableInstrument&) = delete;
+    AwaitableInstrument& operator=(const AwaitableInstrument&) = delete;
+
+    const AisInstrumentHandler& handler() const { return m_handler; }
+
+    struct StopAwaiter {
+        AwaitableInstrument& instrument;
+        uint8_t channel;
+        QString reason;
+        std::coroutine_handle<> handle;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> awaiting)
+        {
+            handle = awaiting;
+            instrument.m_channels[channel].stopWaiters.push_back(this);
+        }
+        QString await_resume() const { return reason; }
+    };
+
+    struct RunAwaiter {
+        AwaitableInstrument& instrument;
+        uint8_t channel;
+        std::shared_ptr<AisExperiment> experiment;
+        ExperimentResult result;
+        StopAwaiter stop { instrument, channel, QString(), {} };
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> awaiting)
+        {
+            // wait for the stop before starting, so a stop that is reported right away is not missed
+            stop.await_suspend(awaiting);
+            result.error = instrument.m_handler.uploadExperimentToChannel(channel, experiment);
+            if (!result.error)
+                result.error = instrument.m_handler.startUploadedExperiment(channel);
+            if (!result.error)
+                return true;
+
+            auto& waiters = instrument.m_channels[channel].stopWaiters;
+            waiters.erase(std::remove(waiters.begin(), waiters.end(), &stop), waiters.end());
+            return false;
+        }
+        ExperimentResult await_resume()
+        {
+            result.reason = stop.reason;
+            return result;
+        }
+    };
+
+    struct ElementAwaiter {
+        AwaitableInstrument& instrument;
+        uint8_t channel;
+        std::optional<AisExperimentNode> node;
+        std::coroutine_handle<> handle;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> awaiting)
+        {
+            handle = awaiting;
+            instrument.m_channels[channel].elementWaiters.push_back(this);
+        }
+        std::optional<AisExperimentNode> await_resume() { return std::move(node); }
+    };
+
+    struct SampleAwaiter {
+        AwaitableInstrument& instrument;
+        uint8_t channel;
+        size_t count;
+        std::vector<AisDCData> samples;
+        std::coroutine_handle<> handle;
+
+        bool await_ready() const noexcept { return count == 0; }
+        void await_suspend(std::coroutine_handle<> awaiting)
+        {
+            handle = awaiting;
+            samples.reserve(count);
+            instrument.m_channels[channel].sampleWaiters.push_back(this);
+        }
+        std::vector<AisDCData> await_resume() { return std::move(samples); }
+    };
+
+    /**
+     * @brief uploads and starts an experiment, and resumes when it stops or right away if it could not be started.
+     */
+    RunAwaiter runExperiment(uint8_t channel, std::shared_ptr<AisExperiment> experiment) { return { *this, checked(channel), std::move(experiment), {} }; }
+
+    /**
+     * @brief resumes with the reason when the experiment on the channel stops.
+     */
+    StopAwaiter experimentStopped(uint8_t channel) { return { *this, checked(channel), QString(), {} }; }
+
+    /**
+     * @brief resumes with the next element that starts, or with nothing when the experiment stops first.
+     */
+    ElementAwaiter nextElement(uint8_t channel) { return { *this, checked(channel), std::nullopt, {} }; }
+
+    /**
+     * @brief resumes with the next count DC samples, or with the samples so far when the experiment stops first.
+     */
+    SampleAwaiter dcSamples(uint8_t channel, size_t count) { return { *this, checked(channel), count, {}, {} }; }
+
+private:
+    struct ChannelWaiters {
+        std::vector<StopAwaiter*> stopWaiters;
+        std::vector<ElementAwaiter*> elementWaiters;
+        std::vector<SampleAwaiter*> sampleWaiters;
+    };
+
+    uint8_t checked(uint8_t channel) const
+    {
+        if (channel >= m_channels.size())
+            qFatal("Channel %d does not exist on this device", channel);
+        return channel;
+    }
+
+    // the waiters are taken off their list before they resume, since a resumed control flow may await again right away
+
+    void onSample(uint8_t channel, const AisDCData& data)
+    {
+        if (channel >= m_channels.size())
+            return;
+        std::vector<SampleAwaiter*> completed;
+        auto& waiters = m_channels[channel].sampleWaiters;
+        for (auto it = waiters.begin(); it != waiters.end();) {
+            (*it)->samples.push_back(data);
+            if ((*it)->samples.size() < (*it)->count) {
+                ++it;
+                continue;
+            }
+            completed.push_back(*it);
+            it = waiters.erase(it);
+        }
+        for (SampleAwaiter* waiter : completed)
+            waiter->handle.resume();
+    }
+
+    void onNewElement(uint8_t channel, const AisExperimentNode& node)
+    {
+        if (channel >= m_channels.size())
+            return;
+        std::vector<ElementAwaiter*> waiters;
+        waiters.swap(m_channels[channel].elementWaiters);
+        for (ElementAwaiter* waiter : waiters) {
+            waiter->node = node;
+            waiter->handle.resume();
+        }
+    }
+
+    void onStopped(uint8_t channel, const QString& reason)
+    {
+        if (channel >= m_channels.size())
+            return;
+        ChannelWaiters waiters;
+        std::swap(waiters, m_channels[channel]);
+        for (SampleAwaiter* waiter : waiters.sampleWaiters)
+            waiter->handle.resume();
+        for (ElementAwaiter* waiter : waiters.elementWaiters)
+            waiter->handle.resume();
+        for (StopAwaiter* waiter : waiters.stopWaiters) {
+            waiter->reason = reason;
+            waiter->handle.resume();
+        }
+    }
+
+    const AisInstrumentHandler& m_handler;
+    std::vector<ChannelWaiters> m_channels;
+    std::vector<QMetaObject::Connection> m_connections;
+};
+
+/**
+ * The workflow of advancedControlFlow.cpp for one channel, with the timers standing in for external conditions.
+ */
+ControlFlow runSequence(AwaitableInstrument& instrument, uint8_t channel, std::shared_ptr<AisExperiment> experimentA,
+    std::shared_ptr<AisExperiment> experimentB, std::shared_ptr<AisExperiment> experimentC)
+{
+    co_await delay(1000);
+    qDebug() << "Channel" << channel << ": starting experiment A";
+    ExperimentResult result = co_await instrument.runExperiment(channel, experimentA);
+    if (result.error) {
+        qDebug() << "Channel" << channel << ":" << result.error.message();
+        co_return;
+    }
+    qDebug() << "Channel" << channel << ": experiment A stopped:" << result.reason;
+
+    // start experiment B, look at its first samples and stop it early
+    co_await delay(10000);
+    AisErrorCode error = instrument.handler().uploadExperimentToChannel(channel, experimentB);
+    if (!error)
+        error = instrument.handler().startUploadedExperiment(channel);
+    if (error) {
+        qDebug() << "Channel" << channel << ":" << error.message();
+        co_return;
+    }
+    std::vector<AisDCData> samples = co_await instrument.dcSamples(channel, 2);
+    for (const AisDCData& sample : samples)
+        qDebug() << "Channel" << channel << ": experiment B current" << sample.current << "voltage" << sample.workingElectrodeVoltage;
+    // fewer samples mean experiment B already stopped by itself, and its stop will not be reported again
+    if (samples.size() == 2) {
+        instrument.handler().stopExperiment(channel);
+        qDebug() << "Channel" << channel << ": experiment B stopped:" << co_await instrument.experimentStopped(channel);
+    } else {
+        qDebug() << "Channel" << channel << ": experiment B stopped before two samples arrived";
+    }
+
+    // run experiment C and follow its elements
+    co_await delay(10000);
+    error = instrument.handler().uploadExperimentToChannel(channel, experimentC);
+    if (!error)
+        error = instrument.handler().startUploadedExperiment(channel);
+    if (error) {
+        qDebug() << "Channel" << channel << ":" << error.message();
+        co_return;
+    }
+    while (std::optional<AisExperimentNode> node = co_await instrument.nextElement(channel))
+        qDebug() << "Channel" << channel << ": experiment C element" << node->stepName << "step" << node->stepNumber;
+
+    co_await delay(10000);
+    result = co_await instrument.runExperiment(channel, experimentB);
+    qDebug() << "Channel" << channel << ": sequence finished:" << (result.error ? result.error.message() : result.reason);
+}
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // the experiments of advancedControlFlow.cpp
+    AisConstantPotElement cvElement(5, 1, 10);
+    AisConstantCurrentElement ccElement(0.002, 1, 10);
+    auto experimentA = std::make_shared<AisExperiment>();
+    experimentA->appendElement(cvElement, 1);
+    auto experimentB = std::make_shared<AisExperiment>();
+    experimentB->appendElement(ccElement, 1);
+    auto experimentC = std::make_shared<AisExperiment>();
+    experimentC->appendElement(cvElement, 2);
+
+    std::vector<std::shared_ptr<AwaitableInstrument>> instruments;
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [&](const QString& deviceName) {
+        auto instrument = std::make_shared<AwaitableInstrument>(tracker->getInstrumentHandler(deviceName));
+        instruments.push_back(instrument);
+
+        // one control flow per free channel, all of them running on the event loop
+        for (uint8_t channel : instrument->handler().getFreeChannels())
+            runSequence(*instrument, channel, experimentA, experimentB, experimentC).detach();
+    });
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << "Error: " << error.message();
+        return 0;
+    }
+
+    return a.exec();
+}
@@ -0,0 +1,270 @@
+/**
+ * \example cyclicVoltammetryPeaks.cpp
+ * This example shows how to find the anodic and cathodic peaks of a cyclic voltammetry while the experiment is running.
+ *
+ * The sweep is split into segments using the vertex parameters of the `AisCyclicVoltammetryElement`: a segment ends whenever
+ * the working electrode voltage reaches the vertex it was heading to. At the start of every segment a straight baseline is
+ * fitted to the current over the first part of the sweep. Past that, the baseline corrected current is tracked and a peak
+ * is reported as soon as the current has dropped sufficiently below its maximum, without waiting for the segment to end.
+ * Once a cycle has both peaks, the peak separation (&Delta;Ep) and the drift of the peak potentials from the previous cycle are reported.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisCyclicVoltammetryElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+#define CHANNEL 0
+
+/**
+ * A current peak found on one segment of the sweep.
+ */
+struct CVPeak {
+    bool valid = false;
+    double timestamp = 0;
+    double potential = 0;
+    double current = 0; ///< the measured current at the peak in Amps.
+    double correctedCurrent = 0; ///< the peak current above the segment baseline in Amps.
+};
+
+/**
+ * The metrics of one complete cycle.
+ */
+struct CVCycleMetrics {
+    int cycle = 0;
+    CVPeak anodic;
+    CVPeak cathodic;
+    double peakSeparation = 0; ///< Epa - Epc in volts.
+    double anodicPotentialDrift = 0; ///< change of Epa from the previous cycle in volts.
+    double cathodicPotentialDrift = 0; ///< change of Epc from the previous cycle in volts.
+};
+
+/**
+ * Segments a cyclic voltammetry sweep on its vertices and finds the peak of every segment incrementally.
+ */
+class CVPeakAnalyzer {
+public:
+    using PeakCallback = std::function<void(bool anodic, const CVPeak&)>;
+    using CycleCallback = std::function<void(const CVCycleMetrics&)>;
+
+    /**
+     * @param element the element being run. Its voltage limits are expected to be absolute, not versus OCP.
+     * @param baselineFraction the fraction of every segment used to fit its baseline.
+     * @param peakDropFraction how far the corrected current has to fall below its maximum before the peak is reported.
+     */
+    CVPeakAnalyzer(AisCyclicVoltammetryElement& element, double baselineFraction = 0.1, double peakDropFraction = 0.05)
+        : m_firstVertex(element.getFirstVoltageLimit())
+        , m_secondVertex(element.getSecondVoltageLimit())
+        , m_numberOfCycles(static_cast<int>(element.getNumberOfCycles()))
+        , m_baselineFraction(baselineFraction)
+        , m_peakDropFraction(peakDropFraction)
+    {
+        // a vertex counts as reached within two samples of it
+        m_vertexTolerance = std::max(2 * element.getdEdt() * element.getSamplingInterval(), 1e-3);
+    }
+
+    void setPeakCallback(PeakCallback callback) { m_peakCallback = std::move(callback); }
+    void setCycleCallback(CycleCallback callback) { m_cycleCallback = std::move(callback); }
+
+    void reset()
+    {
+        m_started = false;
+        m_cycle = 0;
+        m_current = CVCycleMetrics();
+        m_previous = CVCycleMetrics();
+    }
+
+    void addSample(const AisDCData& data)
+    {
+        double potential = data.workingElectrodeVoltage;
+        if (!m_started) {
+            m_started = true;
+            startSegment(m_firstVertex, potential);
+        }
+
+        if (!m_baselineFrozen) {
+            if (std::fabs(potential - m_segmentStart) <= m_baselineFraction * std::fabs(m_target - m_segmentStart)) {
+                addToBaseline(potential, data.current);
+                return;
+            }
+            freezeBaseline();
+        }
+
+        double corrected = m_direction * (data.current - (m_baselineIntercept + m_baselineSlope * potential));
+        if (!m_peak.valid || corrected > m_peak.correctedCurrent) {
+            m_peak = { true, data.timestamp, potential, data.current, corrected };
+            m_peakReported = false;
+        } else if (!m_peakReported && m_peak.correctedCurrent > 0 && corrected < (1 - m_peakDropFraction) * m_peak.correctedCurrent) {
+            reportPeak();
+        }
+
+        if (m_direction * (potential - m_target) >= -m_vertexTolerance)
+            endSegment(potential);
+    }
+
+private:
+    void startSegment(double target, double potential)
+    {
+        m_target = target;
+        m_direction = target >= potential ? 1 : -1;
+        m_segmentStart = potential;
+        m_baselineFrozen = false;
+        m_n = m_sumX = m_sumY = m_sumXX = m_sumXY = 0;
+        m_baselineSlope = m_baselineIntercept = 0;
+        m_peak = CVPeak();
+        m_peakReported = false;
+    }
+
+    void endSegment(double potential)
+    {
+        if (m_peak.valid && !m_peakReported)
+            reportPeak();
+
+        bool cycleCompleted = m_target == m_firstVertex && m_current.anodic.valid && m_current.cathodic.valid;
+        if (cycleCompleted && m_cycle < m_numberOfCycles) {
+            m_current.cycle = ++m_cycle;
+            m_current.peakSeparation = m_current.anodic.potential - m_current.cathodic.potential;
+            if (m_previous.cycle > 0) {
+                m_current.anodicPotentialDrift = m_current.anodic.potential - m_previous.anodic.potential;
+                m_current.cathodicPotentialDrift = m_current.cathodic.potential - m_previous.cathodic.potential;
+            }
+            if (m_cycleCallback)
+                m_cycleCallback(m_current);
+            m_previous = m_current;
+        }
+        if (m_target == m_firstVertex)
+            m_current = CVCycleMetrics();
+
+        startSegment(m_target == m_firstVertex ? m_secondVertex : m_firstVertex, potential);
+    }
+
+    void reportPeak()
+    {
+        m_peakReported = true;
+        bool anodic = m_direction > 0;
+        (anodic ? m_current.anodic : m_current.cathodic) = m_peak;
+        if (m_peakCallback)
+            m_peakCallback(anodic, m_peak);
+    }
+
+    void addToBaseline(double x, double y)
+    {
+        m_n += 1;
+        m_sumX += x;
+        m_sumY += y;
+        m_sumXX += x * x;
+        m_sumXY += x * y;
+    }
+
+    void freezeBaseline()
+    {
+        m_baselineFrozen = true;
+        if (m_n < 1)
+            return;
+        double denominator = m_n * m_sumXX - m_sumX * m_sumX;
+        if (m_n < 2 || std::fabs(denominator) < 1e-18) {
+            m_baselineIntercept = m_sumY / m_n;
+            return;
+        }
+        m_baselineSlope = (m_n * m_sumXY - m_sumX * m_sumY) / denominator;
+        m_baselineIntercept = (m_sumY - m_baselineSlope * m_sumX) / m_n;
+    }
+
+    double m_firstVertex;
+    double m_secondVertex;
+    int m_numberOfCycles;
+    double m_baselineFraction;
+    double m_peakDropFraction;
+    double m_vertexTolerance;
+
+    bool m_started = false;
+    double m_target = 0;
+    int m_direction = 1;
+    double m_segmentStart = 0;
+
+    bool m_baselineFrozen = false;
+    double m_n = 0, m_sumX = 0, m_sumY = 0, m_sumXX = 0, m_sumXY = 0;
+    double m_baselineSlope = 0;
+    double m_baselineIntercept = 0;
+
+    CVPeak m_peak;
+    bool m_peakReported = false;
+
+    int m_cycle = 0;
+    CVCycleMetrics m_current;
+    CVCycleMetrics m_previous;
+
+    PeakCallback m_peakCallback;
+    CycleCallback m_cycleCallback;
+};
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // start at 0V, sweep between 0.6V and -0.2V at 100mV/s, sample every 10ms, 5 cycles and end at 0V
+    AisCyclicVoltammetryElement cvElement(0, 0.6, -0.2, 0, 0.1, 0.01);
+    cvElement.setStartVoltageVsOCP(false);
+    cvElement.setFirstVoltageLimitVsOCP(false);
+    cvElement.setSecondVoltageLimitVsOCP(false);
+    cvElement.setEndVoltageVsOCP(false);
+    cvElement.setNumberOfCycles(5);
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendElement(cvElement, 1);
+
+    auto analyzer = std::make_shared<CVPeakAnalyzer>(cvElement);
+    analyzer->setPeakCallback([](bool anodic, const CVPeak& peak) {
+        qDebug() << (anodic ? "Anodic" : "Cathodic") << "peak at" << peak.potential << "V, " << peak.correctedCurrent << "A above baseline";
+    });
+    analyzer->setCycleCallback([](const CVCycleMetrics& metrics) {
+        qDebug() << "Cycle" << metrics.cycle << ": Epa" << metrics.anodic.potential << " Epc" << metrics.cathodic.potential
+                 << " dEp" << metrics.peakSeparation << " ipa/ipc" << std::fabs(metrics.anodic.correctedCurrent / metrics.cathodic.correctedCurrent)
+                 << " Epa drift" << metrics.anodicPotentialDrift << " Epc drift" << metrics.cathodicPotentialDrift;
+    });
+
+    auto connectSignals = [=](const AisInstrumentHandler& handler) {
+        QObject::connect(&handler, &AisInstrumentHandler::activeDCDataReady, [=](uint8_t channel, const AisDCData& data) {
+            analyzer->addSample(data);
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString& reason) {
+            qDebug() << "Experiment Stopped Signal " << channel << "Reason : " << reason;
+            analyzer->reset();
+        });
+    };
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        connectSignals(handler);
+
+        auto error = handler.uploadExperimentToChannel(CHANNEL, experiment);
+        if (error) {
+            qDebug() << error.message();
+            return;
+        }
+        error = handler.startUploadedExperiment(CHANNEL);
+        if (error) {
+            qDebug() << error.message();
+        }
+    });
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << "Error: " << error.message();
+        return 0;
+    }
+
+    return a.exec();
+}
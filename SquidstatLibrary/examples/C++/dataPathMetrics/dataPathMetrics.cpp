@@ -0,0 +1,318 @@
+/**
+ * \example dataPathMetrics.cpp
+ * This example shows how to keep per channel metrics of the data path, and expose them in the Prometheus text format so
+ * that degradation can be alarmed on before data is lost.
+ *
+ * `DataPathMetrics` listens to the signals of every added handler and keeps, per device and channel:
+ * - counters of the DC and AC samples received and of their payload bytes,
+ * - an estimate of the dropped samples, from gaps in the device timestamps that are larger than the sampling interval,
+ * - a histogram of the delivery latency: the host time at which a sample was received minus the time it was taken,
+ *   from AisInstrumentHandler::getExperimentUTCStartTime plus the sample timestamp. This includes any offset between
+ *   the host and instrument clocks, so its changes matter more than its absolute value.
+ *
+ * Per device it keeps a histogram of the round trip of every command type sent through DataPathMetrics::timed, and
+ * globally it measures how late a timer fires on the event loop, which grows when signals queue up.
+ *
+ * The metrics are written every few seconds to a file that the node exporter textfile collector can pick up.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantPotElement.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QTimer>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+#define CHANNEL 0
+#define METRICS_FILE "squidstat.prom"
+
+/**
+ * A histogram with fixed millisecond buckets, in the form Prometheus expects.
+ */
+class LatencyHistogram {
+public:
+    static constexpr std::array<double, 12> Bounds = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000 };
+
+    void record(double milliseconds)
+    {
+        size_t bucket = std::upper_bound(Bounds.begin(), Bounds.end(), milliseconds) - Bounds.begin();
+        if (bucket > 0 && milliseconds == Bounds[bucket - 1])
+            --bucket;
+        ++m_counts[bucket];
+        m_sum += milliseconds;
+        ++m_count;
+    }
+
+    quint64 count() const { return m_count; }
+
+    /**
+     * @brief writes the cumulative buckets, the sum and the count of the histogram.
+     * @param labels the labels of the series without braces, for example: device="Plus2001",channel="0"
+     */
+    void write(QTextStream& out, const QString& name, const QString& labels) const
+    {
+        quint64 cumulative = 0;
+        for (size_t i = 0; i < Bounds.size(); ++i) {
+            cumulative += m_counts[i];
+            out << name << "_bucket{" << labels << ",le=\"" << Bounds[i] << "\"} " << cumulative << "\n";
+        }
+        out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << m_count << "\n";
+        out << name << "_sum{" << labels << "} " << m_sum << "\n";
+        out << name << "_count{" << labels << "} " << m_count << "\n";
+    }
+
+private:
+    std::array<quint64, Bounds.size() + 1> m_counts {};
+    double m_sum = 0;
+    quint64 m_count = 0;
+};
+
+/**
+ * The metrics of one channel.
+ */
+struct ChannelMetrics {
+    quint64 dcSamples = 0;
+    quint64 acSamples = 0;
+    quint64 payloadBytes = 0; ///< the size of the decoded samples, a lower bound of the traffic on the link.
+    quint64 droppedSamples = 0; ///< an estimate from gaps in the device timestamps.
+    double samplesPerSecond = 0; ///< the rate since the previous snapshot.
+    LatencyHistogram deliveryLatency;
+
+    // state to derive the metrics from
+    double experimentStart = -1; ///< the UTC start of the running experiment in seconds, -1 if unknown.
+    double lastTimestamp = -1;
+    double interval = 0; ///< a running estimate of the sampling interval in seconds.
+    quint64 samplesAtSnapshot = 0;
+};
+
+/**
+ * Collects data path metrics of all added handlers.
+ */
+class DataPathMetrics {
+public:
+    DataPathMetrics()
+    {
+        m_clock.start();
+        m_lastSnapshot = m_clock.elapsed();
+
+        // a timer that should fire every 100ms; how late it fires is the lag of the event loop
+        m_lagTimer.setInterval(100);
+        QObject::connect(&m_lagTimer, &QTimer::timeout, [this]() {
+            qint64 now = m_clock.elapsed();
+            if (m_lastLagTick >= 0)
+                m_eventLoopLag = std::max(m_eventLoopLag, static_cast<double>(now - m_lastLagTick - m_lagTimer.interval()));
+            m_lastLagTick = now;
+        });
+        m_lagTimer.start();
+    }
+
+    void addDevice(const QString& deviceName, const AisInstrumentHandler& handler)
+    {
+        const AisInstrumentHandler* source = &handler;
+        QObject::connect(source, &AisInstrumentHandler::activeDCDataReady, [=](uint8_t channel, const AisDCData& data) {
+            onSample(deviceName, *source, channel, data.timestamp, sizeof(AisDCData), true);
+        });
+        QObject::connect(source, &AisInstrumentHandler::activeACDataReady, [=](uint8_t channel, const AisACData& data) {
+            onSample(deviceName, *source, channel, data.timestamp, sizeof(AisACData), false);
+        });
+        QObject::connect(source, &AisInstrumentHandler::experimentNewElementStarting, [=](uint8_t channel, const AisExperimentNode&) {
+            // the sampling interval changes between elements, so the gap detection starts over
+            ChannelMetrics& metrics = m_channels[{ deviceName, channel }];
+            metrics.lastTimestamp = -1;
+            metrics.interval = 0;
+        });
+        QObject::connect(source, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString&) {
+            ChannelMetrics& metrics = m_channels[{ deviceName, channel }];
+            metrics.experimentStart = -1;
+            metrics.lastTimestamp = -1;
+            metrics.interval = 0;
+        });
+    }
+
+    /**
+     * @brief runs a command and records its round trip under the given command name.
+     * @return the result of the command.
+     */
+    template <typename Command>
+    AisErrorCode timed(const QString& deviceName, const QString& commandName, Command command)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        AisErrorCode error = command();
+        m_commands[{ deviceName, commandName }].record(timer.nsecsElapsed() / 1e6);
+        if (error)
+            ++m_commandErrors[{ deviceName, commandName }];
+        return error;
+    }
+
+    /**
+     * @brief updates the rates over the time since the previous snapshot and writes all metrics in the Prometheus text format.
+     */
+    QString snapshot()
+    {
+        qint64 now = m_clock.elapsed();
+        double seconds = std::max<qint64>(now - m_lastSnapshot, 1) / 1000.0;
+        m_lastSnapshot = now;
+
+        QString text;
+        QTextStream out(&text);
+        header(out, "squidstat_samples_total", "counter", "Samples received, by kind.");
+        for (const auto& entry : m_channels) {
+            out << "squidstat_samples_total{" << labels(entry.first) << ",kind=\"dc\"} " << entry.second.dcSamples << "\n";
+            out << "squidstat_samples_total{" << labels(entry.first) << ",kind=\"ac\"} " << entry.second.acSamples << "\n";
+        }
+        header(out, "squidstat_payload_bytes_total", "counter", "Bytes of decoded sample payload received.");
+        for (const auto& entry : m_channels)
+            out << "squidstat_payload_bytes_total{" << labels(entry.first) << "} " << entry.second.payloadBytes << "\n";
+        header(out, "squidstat_dropped_samples_total", "counter", "Samples missing from gaps in the device timestamps.");
+        for (const auto& entry : m_channels)
+            out << "squidstat_dropped_samples_total{" << labels(entry.first) << "} " << entry.second.droppedSamples << "\n";
+
+        header(out, "squidstat_samples_per_second", "gauge", "Samples received per second since the previous snapshot.");
+        for (auto& entry : m_channels) {
+            ChannelMetrics& metrics = entry.second;
+            quint64 samples = metrics.dcSamples + metrics.acSamples;
+            metrics.samplesPerSecond = (samples - metrics.samplesAtSnapshot) / seconds;
+            metrics.samplesAtSnapshot = samples;
+            out << "squidstat_samples_per_second{" << labels(entry.first) << "} " << metrics.samplesPerSecond << "\n";
+        }
+
+        header(out, "squidstat_delivery_latency_milliseconds", "histogram", "Host receive time minus the device sample time.");
+        for (const auto& entry : m_channels)
+            entry.second.deliveryLatency.write(out, "squidstat_delivery_latency_milliseconds", labels(entry.first));
+
+        header(out, "squidstat_command_latency_milliseconds", "histogram", "Round trip of commands, by command type.");
+        for (const auto& entry : m_commands)
+            entry.second.write(out, "squidstat_command_latency_milliseconds", commandLabels(entry.first));
+        header(out, "squidstat_command_errors_total", "counter", "Commands that returned an error, by command type.");
+        for (const auto& entry : m_commandErrors)
+            out << "squidstat_command_errors_total{" << commandLabels(entry.first) << "} " << entry.second << "\n";
+
+        header(out, "squidstat_event_loop_lag_milliseconds", "gauge", "The largest event loop delay since the previous snapshot.");
+        out << "squidstat_event_loop_lag_milliseconds " << m_eventLoopLag << "\n";
+        m_eventLoopLag = 0;
+
+        out.flush();
+        return text;
+    }
+
+    /**
+     * @brief writes a snapshot to a file, replacing it atomically so a reader never sees a partial file.
+     */
+    bool writeSnapshot(const QString& path)
+    {
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+            return false;
+        file.write(snapshot().toUtf8());
+        return file.commit();
+    }
+
+private:
+    using ChannelKey = std::pair<QString, uint8_t>;
+    using CommandKey = std::pair<QString, QString>;
+
+    void onSample(const QString& deviceName, const AisInstrumentHandler& handler, uint8_t channel, double timestamp, size_t bytes, bool dc)
+    {
+        double received = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+        ChannelMetrics& metrics = m_channels[{ deviceName, channel }];
+        ++(dc ? metrics.dcSamples : metrics.acSamples);
+        metrics.payloadBytes += bytes;
+
+        if (metrics.experimentStart < 0)
+            metrics.experimentStart = handler.getExperimentUTCStartTime(channel);
+        metrics.deliveryLatency.record(std::max(0.0, (received - metrics.experimentStart - timestamp) * 1000));
+
+        // AC points are one per frequency and have no regular interval
+        if (!dc)
+            return;
+        if (metrics.lastTimestamp >= 0) {
+            double gap = timestamp - metrics.lastTimestamp;
+            if (metrics.interval > 0 && gap > 1.5 * metrics.interval)
+                metrics.droppedSamples += static_cast<quint64>(std::llround(gap / metrics.interval)) - 1;
+            else if (gap > 0)
+                metrics.interval = metrics.interval > 0 ? 0.9 * metrics.interval + 0.1 * gap : gap;
+        }
+        metrics.lastTimestamp = timestamp;
+    }
+
+    static void header(QTextStream& out, const char* name, const char* type, const char* help)
+    {
+        out << "# HELP " << name << " " << help << "\n";
+        out << "# TYPE " << name << " " << type << "\n";
+    }
+
+    static QString labels(const ChannelKey& key) { return QString("device=\"%1\",channel=\"%2\"").arg(key.first).arg(key.second); }
+    static QString commandLabels(const CommandKey& key) { return QString("device=\"%1\",command=\"%2\"").arg(key.first, key.second); }
+
+    QElapsedTimer m_clock;
+    qint64 m_lastSnapshot;
+    QTimer m_lagTimer;
+    qint64 m_lastLagTick = -1;
+    double m_eventLoopLag = 0;
+
+    std::map<ChannelKey, ChannelMetrics> m_channels;
+    std::map<CommandKey, LatencyHistogram> m_commands;
+    std::map<CommandKey, quint64> m_commandErrors;
+};
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+    auto metrics = std::make_shared<DataPathMetrics>();
+
+    // hold 0.1V for 10 minutes, sampled every 10ms
+    AisConstantPotElement cvElement(0.1, 0.01, 600);
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendElement(cvElement, 1);
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        metrics->addDevice(deviceName, handler);
+
+        auto error = metrics->timed(deviceName, "uploadExperimentToChannel", [&]() { return handler.uploadExperimentToChannel(CHANNEL, experiment); });
+        if (error) {
+            qDebug() << error.message();
+            return;
+        }
+        error = metrics->timed(deviceName, "startUploadedExperiment", [&]() { return handler.startUploadedExperiment(CHANNEL); });
+        if (error) {
+            qDebug() << error.message();
+        }
+    });
+
+    // write the metrics every 5 seconds
+    QTimer exportTimer;
+    QObject::connect(&exportTimer, &QTimer::timeout, &a, [=]() {
+        if (!metrics->writeSnapshot(METRICS_FILE))
+            qDebug() << "Could not write" << METRICS_FILE;
+    });
+    exportTimer.start(5000);
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << "Error: " << error.message();
+        return 0;
+    }
+
+    return a.exec();
+}
@@ -0,0 +1,305 @@
+/**
+ * \example differentialCapacity.cpp
+ * This example shows how to compute differential capacity (dQ/dV) and its inverse (dV/dQ) incrementally while a constant current
+ * element is running, instead of buffering the whole charge or discharge and post-processing it afterwards.
+ *
+ * Every DC sample received through AisInstrumentHandler::activeDCDataReady adds the charge passed since the previous sample
+ * into a voltage bin. Smoothing is a moving average over neighbouring bins and is only recomputed for the bins that changed
+ * since the last query, so the cost of a query does not grow with the length of the experiment. The bins are kept with room
+ * on both sides, so a curve that grows towards lower voltages, as in a discharge, costs the same as one that grows upwards.
+ *
+ * Run the example with "--benchmark" to process a synthetic one million point discharge without an instrument attached.
+ */
+
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantCurrentElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStandardPaths>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+#define CHANNEL 0
+
+/**
+ * Accumulates charge into fixed width voltage bins and keeps a smoothed dQ/dV curve up to date.
+ * Bins are stored contiguously so that the smoothing pass is a simple loop over arrays. The curve covers the bins
+ * [m_begin, m_end) of the storage, which grows by doubling at either end.
+ */
+class IncrementalDifferentialCapacity {
+public:
+    /**
+     * @param binWidth the width of a voltage bin in volts.
+     * @param smoothingHalfWindow the number of neighbouring bins on each side used by the moving average (0 disables smoothing).
+     */
+    IncrementalDifferentialCapacity(double binWidth, int smoothingHalfWindow)
+        : m_binWidth(binWidth)
+        , m_halfWindow(std::max(0, smoothingHalfWindow))
+    {
+    }
+
+    void reset()
+    {
+        m_charge.clear();
+        m_smoothed.clear();
+        m_begin = m_end = 0;
+        m_hasPrevious = false;
+        m_dirtyBegin = m_dirtyEnd = 0;
+    }
+
+    void addSample(const AisDCData& data)
+    {
+        if (!m_hasPrevious) {
+            m_previous = data;
+            m_hasPrevious = true;
+            if (m_begin == m_end)
+                m_origin = std::floor(data.workingElectrodeVoltage / m_binWidth) * m_binWidth;
+            return;
+        }
+
+        // trapezoidal charge in Ah, assigned to the bin of the mid-point voltage
+        double dq = 0.5 * (data.current + m_previous.current) * (data.timestamp - m_previous.timestamp) / 3600.0;
+        double v = 0.5 * (data.workingElectrodeVoltage + m_previous.workingElectrodeVoltage);
+        m_previous = data;
+
+        long bin = binIndex(v);
+        m_charge[bin] += std::fabs(dq);
+        markDirty(bin);
+    }
+
+    /**
+     * @brief brings the smoothed curve up to date with all samples added so far. Only touched bins are recomputed.
+     */
+    void update()
+    {
+        if (m_dirtyBegin >= m_dirtyEnd)
+            return;
+
+        long first = std::max(m_begin, m_dirtyBegin - m_halfWindow);
+        long last = std::min(m_end, m_dirtyEnd + m_halfWindow);
+
+        // sliding window sum over [i - h, i + h], normalised by the number of bins inside the curve
+        double sum = 0;
+        long lo = std::max(m_begin, first - m_halfWindow);
+        long hi = std::min(m_end, first + m_halfWindow + 1);
+        for (long j = lo; j < hi; ++j)
+            sum += m_charge[j];
+
+        const double* charge = m_charge.data();
+        double* smoothed = m_smoothed.data();
+        for (long i = first; i < last; ++i) {
+            smoothed[i] = sum / static_cast<double>(hi - lo) / m_binWidth;
+            if (i - m_halfWindow >= m_begin) {
+                sum -= charge[i - m_halfWindow];
+                ++lo;
+            }
+            if (i + m_halfWindow + 1 < m_end) {
+                sum += charge[i + m_halfWindow + 1];
+                ++hi;
+            }
+        }
+
+        m_dirtyBegin = m_dirtyEnd = 0;
+    }
+
+    size_t binCount() const { return static_cast<size_t>(m_end - m_begin); }
+    double binVoltage(size_t bin) const { return m_origin + (static_cast<double>(m_begin + bin) + 0.5) * m_binWidth; }
+
+    /// dQ/dV in Ah/V for the given bin.
+    double dQdV(size_t bin) const { return m_smoothed[m_begin + bin]; }
+
+    /// dV/dQ in V/Ah for the given bin, or 0 where no charge was passed.
+    double dVdQ(size_t bin) const { return dQdV(bin) > 0 ? 1.0 / dQdV(bin) : 0.0; }
+
+private:
+    long binIndex(double voltage)
+    {
+        long bin = static_cast<long>(std::floor((voltage - m_origin) / m_binWidth));
+        long size = static_cast<long>(m_charge.size());
+        if (bin < 0) {
+            // below the storage: at least double it at the front, so growing downwards costs O(1) per bin on average
+            long grow = std::max({ -bin, size, MinimumGrowth });
+            m_charge.insert(m_charge.begin(), static_cast<size_t>(grow), 0.0);
+            m_smoothed.insert(m_smoothed.begin(), static_cast<size_t>(grow), 0.0);
+            m_origin -= static_cast<double>(grow) * m_binWidth;
+            bin += grow;
+            m_begin += grow;
+            m_end += grow;
+            if (m_dirtyBegin < m_dirtyEnd) {
+                m_dirtyBegin += grow;
+                m_dirtyEnd += grow;
+            }
+        } else if (bin >= size) {
+            size_t newSize = static_cast<size_t>(std::max({ bin + 1, 2 * size, MinimumGrowth }));
+            m_charge.resize(newSize, 0.0);
+            m_smoothed.resize(newSize, 0.0);
+        }
+
+        if (m_begin == m_end) {
+            m_begin = bin;
+            m_end = bin + 1;
+        } else if (bin < m_begin) {
+            // the bins next to the old edge are now averaged over more neighbours
+            markDirty(m_begin);
+            m_begin = bin;
+        } else if (bin >= m_end) {
+            markDirty(m_end - 1);
+            m_end = bin + 1;
+        }
+        return bin;
+    }
+
+    void markDirty(long bin)
+    {
+        if (m_dirtyBegin >= m_dirtyEnd) {
+            m_dirtyBegin = bin;
+            m_dirtyEnd = bin + 1;
+        } else {
+            m_dirtyBegin = std::min(m_dirtyBegin, bin);
+            m_dirtyEnd = std::max(m_dirtyEnd, bin + 1);
+        }
+    }
+
+    static constexpr long MinimumGrowth = 64;
+
+    double m_binWidth;
+    long m_halfWindow;
+    double m_origin = 0; ///< the lower voltage of the first bin of the storage.
+    long m_begin = 0;
+    long m_end = 0;
+    std::vector<double> m_charge;
+    std::vector<double> m_smoothed;
+    AisDCData m_previous {};
+    bool m_hasPrevious = false;
+    long m_dirtyBegin = 0;
+    long m_dirtyEnd = 0;
+};
+
+static void writeCurve(const IncrementalDifferentialCapacity& curve, const QString& filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return;
+
+    QTextStream out(&file);
+    out << "Voltage (V),dQ/dV (Ah/V),dV/dQ (V/Ah)\n";
+    for (size_t i = 0; i < curve.binCount(); ++i)
+        out << curve.binVoltage(i) << "," << curve.dQdV(i) << "," << curve.dVdQ(i) << "\n";
+}
+
+// Processes a synthetic one million point constant current discharge and reports throughput
+static void runBenchmark()
+{
+    const int numberOfPoints = 1000000;
+    const double current = -0.01;
+    const double samplingInterval = 0.1;
+
+    std::vector<AisDCData> discharge(numberOfPoints);
+    for (int i = 0; i < numberOfPoints; ++i) {
+        double stateOfCharge = 1.0 - static_cast<double>(i) / numberOfPoints;
+        // two voltage plateaus so that the curve has a pair of dQ/dV peaks
+        double voltage = 3.0 + 0.6 * stateOfCharge + 0.1 * std::tanh((stateOfCharge - 0.3) * 40) + 0.1 * std::tanh((stateOfCharge - 0.7) * 40);
+        discharge[i] = { i * samplingInterval, voltage, 0.0, current, 25.0 };
+    }
+
+    IncrementalDifferentialCapacity curve(0.001, 5);
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < numberOfPoints; ++i) {
+        curve.addSample(discharge[i]);
+        // refresh the curve as often as a live plot would
+        if (i % 1000 == 0)
+            curve.update();
+    }
+    curve.update();
+    qint64 elapsed = timer.nsecsElapsed();
+
+    qDebug() << "Processed" << numberOfPoints << "points into" << curve.binCount() << "bins in" << elapsed / 1e6 << "ms"
+             << "(" << static_cast<double>(elapsed) / numberOfPoints << "ns per point, including" << numberOfPoints / 1000 << "curve refreshes )";
+
+    writeCurve(curve, QStandardPaths::writableLocation(QStandardPaths::DesktopLocation) + "/dQdV_benchmark.csv");
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    if (a.arguments().contains("--benchmark")) {
+        runBenchmark();
+        return 0;
+    }
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // A constant current discharge: -10mA, sampled every 0.1s, for at most 10 hours
+    AisConstantCurrentElement ccElement(-0.01, 0.1, 36000);
+    ccElement.setMinVoltage(2.5);
+    auto customExperiment = std::make_shared<AisExperiment>();
+    customExperiment->appendElement(ccElement, 1);
+
+    // 1mV bins, smoothed over +/- 5 bins
+    auto curve = std::make_shared<IncrementalDifferentialCapacity>(0.001, 5);
+    auto isConstantCurrent = std::make_shared<bool>(false);
+    const QString ccName = ccElement.getName();
+
+    auto connectSignals = [=](const AisInstrumentHandler& handler) {
+        QObject::connect(&handler, &AisInstrumentHandler::experimentNewElementStarting, [=](uint8_t channel, const AisExperimentNode& node) {
+            // only constant current segments give a meaningful dQ/dV, so start a fresh curve for each of them
+            *isConstantCurrent = node.stepName == ccName;
+            if (*isConstantCurrent)
+                curve->reset();
+        });
+
+        QObject::connect(&handler, &AisInstrumentHandler::activeDCDataReady, [=](uint8_t channel, const AisDCData& data) {
+            if (!*isConstantCurrent)
+                return;
+            curve->addSample(data);
+
+            static int sampleCount = 0;
+            if (++sampleCount % 100 == 0) {
+                curve->update();
+                qDebug() << "Voltage: " << data.workingElectrodeVoltage << " bins: " << curve->binCount();
+            }
+        });
+
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString& reason) {
+            qDebug() << "Experiment Stopped Signal " << channel << "Reason : " << reason;
+            curve->update();
+            writeCurve(*curve, QStandardPaths::writableLocation(QStandardPaths::DesktopLocation) + "/dQdV.csv");
+        });
+    };
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        connectSignals(handler);
+
+        auto error = handler.uploadExperimentToChannel(CHANNEL, customExperiment);
+        if (error) {
+            qDebug() << error.message();
+            return;
+        }
+        error = handler.startUploadedExperiment(CHANNEL);
+        if (error) {
+            qDebug() << error.message();
+        }
+    });
+
+    AisErrorCode error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << error.message();
+        return 0;
+    }
+
+    return a.exec();
+}
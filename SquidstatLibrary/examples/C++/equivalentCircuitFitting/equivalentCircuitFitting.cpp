@@ -0,0 +1,688 @@
+/**
+ * \example equivalentCircuitFitting.cpp
+ * This example shows how to fit an equivalent circuit to every EIS spectrum as soon as its last frequency arrives.
+ *
+ * The circuit is described with a string where "-" joins elements in series and "p(a,b,...)" puts them in parallel,
+ * for example the Randles circuit "R0-p(R1-W1,C1)". Supported elements are R (resistor), C (capacitor), L (inductor),
+ * W (semi-infinite Warburg) and CPE (constant phase element, two parameters Q and n).
+ *
+ * The fit is a Levenberg-Marquardt least squares on modulus weighted residuals, with the Jacobian computed analytically
+ * through the circuit tree. Parameters are fitted on a logarithmic scale to keep them positive. Every spectrum is fitted
+ * from several starting points in parallel on a thread pool and the best result is kept. The same pool is used by the
+ * batch interface that fits many spectra at once.
+ *
+ * Run the example with "--benchmark" to fit a batch of synthetic Randles spectra without an instrument attached.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisEISPotentiostaticElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <complex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+#define CHANNEL 0
+
+using Complex = std::complex<double>;
+static constexpr double Pi = 3.14159265358979323846;
+
+/**
+ * A parsed equivalent circuit. Evaluates the impedance and its derivative with respect to every parameter.
+ */
+class EquivalentCircuit {
+public:
+    /**
+     * @brief parses a circuit description such as "R0-p(R1-W1,C1)".
+     * @throws std::invalid_argument if the description cannot be parsed.
+     */
+    explicit EquivalentCircuit(const std::string& description)
+        : m_description(description)
+    {
+        size_t position = 0;
+        m_root = parseSeries(position);
+        if (position != m_description.size())
+            throw std::invalid_argument("unexpected character in circuit description at " + std::to_string(position));
+    }
+
+    size_t parameterCount() const { return m_parameterNames.size(); }
+    const std::vector<std::string>& parameterNames() const { return m_parameterNames; }
+    bool isExponent(size_t parameter) const { return m_isExponent[parameter]; }
+
+    /**
+     * @brief computes the impedance at the angular frequency omega and, if derivatives is not null,
+     * dZ/dp for every parameter into derivatives[0 .. parameterCount()).
+     */
+    Complex evaluate(double omega, const double* parameters, Complex* derivatives) const
+    {
+        return evaluate(m_root, omega, parameters, derivatives);
+    }
+
+    /**
+     * @brief a starting guess for every parameter, scaled to the given spectrum.
+     */
+    std::vector<double> initialGuess(const std::vector<AisACData>& spectrum) const
+    {
+        std::vector<double> magnitudes;
+        double peakFrequency = spectrum.front().frequency;
+        double maxImag = 0;
+        double maxFrequency = 0;
+        for (const AisACData& point : spectrum) {
+            magnitudes.push_back(std::hypot(point.realImpedance, point.imagImpedance));
+            if (-point.imagImpedance > maxImag) {
+                maxImag = -point.imagImpedance;
+                peakFrequency = point.frequency;
+            }
+            maxFrequency = std::max(maxFrequency, point.frequency);
+        }
+        std::nth_element(magnitudes.begin(), magnitudes.begin() + magnitudes.size() / 2, magnitudes.end());
+        double scale = std::max(magnitudes[magnitudes.size() / 2], 1e-6);
+
+        std::vector<double> guess;
+        for (size_t i = 0; i < m_parameterTypes.size(); ++i) {
+            switch (m_parameterTypes[i]) {
+            case Resistor:
+                guess.push_back(scale);
+                break;
+            case Capacitor:
+            case ConstantPhase:
+                guess.push_back(m_isExponent[i] ? 0.9 : 1.0 / (2 * Pi * peakFrequency * scale));
+                break;
+            case Inductor:
+                guess.push_back(0.01 * scale / (2 * Pi * maxFrequency));
+                break;
+            case Warburg:
+                guess.push_back(0.1 * scale * std::sqrt(2 * Pi * peakFrequency));
+                break;
+            default:
+                guess.push_back(1.0);
+            }
+        }
+        return guess;
+    }
+
+private:
+    enum NodeType { Series, Parallel, Resistor, Capacitor, Inductor, Warburg, ConstantPhase };
+
+    static constexpr size_t MaxParallelBranches = 16;
+
+    struct Node {
+        explicit Node(NodeType nodeType)
+            : type(nodeType)
+        {
+        }
+
+        NodeType type;
+        size_t firstParameter = 0;
+        size_t endParameter = 0;
+        std::vector<Node> children;
+    };
+
+    Node parseSeries(size_t& position)
+    {
+        Node node(Series);
+        node.firstParameter = m_parameterNames.size();
+        node.children.push_back(parseTerm(position));
+        while (position < m_description.size() && m_description[position] == '-') {
+            ++position;
+            node.children.push_back(parseTerm(position));
+        }
+        node.endParameter = m_parameterNames.size();
+        return node.children.size() == 1 ? node.children.front() : node;
+    }
+
+    Node parseTerm(size_t& position)
+    {
+        if (m_description.compare(position, 2, "p(") == 0) {
+            position += 2;
+            Node node(Parallel);
+            node.firstParameter = m_parameterNames.size();
+            node.children.push_back(parseSeries(position));
+            while (position < m_description.size() && m_description[position] == ',') {
+                ++position;
+                node.children.push_back(parseSeries(position));
+            }
+            if (position >= m_description.size() || m_description[position] != ')')
+                throw std::invalid_argument("missing ')' in circuit description");
+            if (node.children.size() > MaxParallelBranches)
+                throw std::invalid_argument("too many parallel branches in circuit description");
+            ++position;
+            node.endParameter = m_parameterNames.size();
+            return node;
+        }
+
+        size_t start = position;
+        while (position < m_description.size() && std::isalpha(static_cast<unsigned char>(m_description[position])))
+            ++position;
+        std::string kind = m_description.substr(start, position - start);
+        while (position < m_description.size() && std::isdigit(static_cast<unsigned char>(m_description[position])))
+            ++position;
+        std::string name = m_description.substr(start, position - start);
+
+        Node node(Resistor);
+        if (kind == "R")
+            node.type = Resistor;
+        else if (kind == "C")
+            node.type = Capacitor;
+        else if (kind == "L")
+            node.type = Inductor;
+        else if (kind == "W")
+            node.type = Warburg;
+        else if (kind == "CPE")
+            node.type = ConstantPhase;
+        else
+            throw std::invalid_argument("unknown circuit element '" + name + "'");
+
+        node.firstParameter = m_parameterNames.size();
+        if (node.type == ConstantPhase) {
+            addParameter(name + "_Q", node.type, false);
+            addParameter(name + "_n", node.type, true);
+        } else {
+            addParameter(name, node.type, false);
+        }
+        node.endParameter = m_parameterNames.size();
+        return node;
+    }
+
+    void addParameter(const std::string& name, NodeType type, bool exponent)
+    {
+        m_parameterNames.push_back(name);
+        m_parameterTypes.push_back(type);
+        m_isExponent.push_back(exponent);
+    }
+
+    Complex evaluate(const Node& node, double omega, const double* p, Complex* dZ) const
+    {
+        const Complex j(0, 1);
+        size_t k = node.firstParameter;
+        switch (node.type) {
+        case Resistor:
+            if (dZ)
+                dZ[k] = 1;
+            return p[k];
+        case Capacitor: {
+            Complex z = 1.0 / (j * omega * p[k]);
+            if (dZ)
+                dZ[k] = -z / p[k];
+            return z;
+        }
+        case Inductor:
+            if (dZ)
+                dZ[k] = j * omega;
+            return j * omega * p[k];
+        case Warburg: {
+            Complex unit = Complex(1, -1) / std::sqrt(omega);
+            if (dZ)
+                dZ[k] = unit;
+            return p[k] * unit;
+        }
+        case ConstantPhase: {
+            Complex logJOmega(std::log(omega), Pi / 2);
+            Complex z = 1.0 / (p[k] * std::exp(p[k + 1] * logJOmega));
+            if (dZ) {
+                dZ[k] = -z / p[k];
+                dZ[k + 1] = -z * logJOmega;
+            }
+            return z;
+        }
+        case Series: {
+            Complex z = 0;
+            for (const Node& child : node.children)
+                z += evaluate(child, omega, p, dZ);
+            return z;
+        }
+        case Parallel: {
+            // collect the child impedances first, then scale the child derivatives by (Z / Zi)^2
+            Complex admittance = 0;
+            Complex childImpedance[MaxParallelBranches];
+            size_t count = node.children.size();
+            for (size_t i = 0; i < count; ++i) {
+                childImpedance[i] = evaluate(node.children[i], omega, p, dZ);
+                admittance += 1.0 / childImpedance[i];
+            }
+            Complex z = 1.0 / admittance;
+            if (dZ) {
+                for (size_t i = 0; i < count; ++i) {
+                    Complex ratio = z / childImpedance[i];
+                    Complex factor = ratio * ratio;
+                    for (size_t q = node.children[i].firstParameter; q < node.children[i].endParameter; ++q)
+                        dZ[q] *= factor;
+                }
+            }
+            return z;
+        }
+        }
+        return 0;
+    }
+
+    std::string m_description;
+    Node m_root { Series };
+    std::vector<std::string> m_parameterNames;
+    std::vector<NodeType> m_parameterTypes;
+    std::vector<bool> m_isExponent;
+};
+
+/**
+ * The outcome of fitting one spectrum.
+ */
+struct CircuitFitResult {
+    std::vector<double> parameters;
+    double chiSquare = std::numeric_limits<double>::infinity(); ///< the sum of squared modulus weighted residuals.
+    int iterations = 0;
+    /// false if the fit ran out of iterations, or stalled because no step improved it before it met the tolerance. A
+    /// stalled fit can still be at the minimum to the precision of the data, so compare the chi square as well.
+    bool converged = false;
+};
+
+/**
+ * @brief fits the circuit to one spectrum from one starting point with Levenberg-Marquardt.
+ */
+static CircuitFitResult levenbergMarquardt(const EquivalentCircuit& circuit, const std::vector<AisACData>& spectrum, const std::vector<double>& start, int maxIterations = 200)
+{
+    const size_t P = circuit.parameterCount();
+    const size_t M = spectrum.size();
+
+    // fit theta = ln(p) so that every parameter stays positive
+    std::vector<double> theta(P), trial(P), p(P);
+    for (size_t i = 0; i < P; ++i)
+        theta[i] = std::log(start[i]);
+
+    std::vector<Complex> dZ(P);
+    std::vector<double> jtj(P * P), jtr(P), step(P), system(P * P);
+
+    // computes the cost and, when requested, the normal equations J^T J and J^T r
+    auto evaluate = [&](const std::vector<double>& t, bool normalEquations) {
+        for (size_t i = 0; i < P; ++i)
+            p[i] = std::exp(t[i]);
+        if (normalEquations) {
+            std::fill(jtj.begin(), jtj.end(), 0.0);
+            std::fill(jtr.begin(), jtr.end(), 0.0);
+        }
+        double cost = 0;
+        for (size_t m = 0; m < M; ++m) {
+            const AisACData& point = spectrum[m];
+            Complex measured(point.realImpedance, point.imagImpedance);
+            double weight = 1.0 / std::max(std::abs(measured), 1e-12);
+            Complex z = circuit.evaluate(2 * Pi * point.frequency, p.data(), normalEquations ? dZ.data() : nullptr);
+            Complex r = (z - measured) * weight;
+            cost += std::norm(r);
+            if (!normalEquations)
+                continue;
+            for (size_t a = 0; a < P; ++a) {
+                Complex ja = dZ[a] * (p[a] * weight);
+                jtr[a] += ja.real() * r.real() + ja.imag() * r.imag();
+                for (size_t b = 0; b <= a; ++b) {
+                    Complex jb = dZ[b] * (p[b] * weight);
+                    jtj[a * P + b] += ja.real() * jb.real() + ja.imag() * jb.imag();
+                }
+            }
+        }
+        return cost;
+    };
+
+    CircuitFitResult result;
+    double lambda = 1e-3;
+    double cost = evaluate(theta, true);
+    for (result.iterations = 0; result.iterations < maxIterations; ++result.iterations) {
+        // solve (J^T J + lambda diag(J^T J)) step = -J^T r with a Cholesky factorization
+        for (size_t a = 0; a < P; ++a) {
+            for (size_t b = 0; b <= a; ++b)
+                system[a * P + b] = jtj[a * P + b];
+            system[a * P + a] += lambda * std::max(jtj[a * P + a], 1e-12);
+        }
+        bool factored = true;
+        for (size_t a = 0; a < P && factored; ++a) {
+            for (size_t b = 0; b <= a; ++b) {
+                double sum = system[a * P + b];
+                for (size_t k = 0; k < b; ++k)
+                    sum -= system[a * P + k] * system[b * P + k];
+                if (a == b) {
+                    if (sum <= 0) {
+                        factored = false;
+                        break;
+                    }
+                    system[a * P + a] = std::sqrt(sum);
+                } else {
+                    system[a * P + b] = sum / system[b * P + b];
+                }
+            }
+        }
+        if (!factored) {
+            lambda *= 10;
+            continue;
+        }
+        for (size_t a = 0; a < P; ++a) {
+            double sum = -jtr[a];
+            for (size_t k = 0; k < a; ++k)
+                sum -= system[a * P + k] * step[k];
+            step[a] = sum / system[a * P + a];
+        }
+        for (size_t a = P; a-- > 0;) {
+            double sum = step[a];
+            for (size_t k = a + 1; k < P; ++k)
+                sum -= system[k * P + a] * step[k];
+            step[a] = sum / system[a * P + a];
+        }
+
+        // limit every step to a factor of e per parameter, otherwise a parameter can jump to a value where it no longer
+        // affects the impedance and the fit stalls there
+        double stepNorm = 0;
+        for (size_t i = 0; i < P; ++i)
+            stepNorm = std::max(stepNorm, std::fabs(step[i]));
+        double stepScale = stepNorm > 1 ? 1 / stepNorm : 1;
+        for (size_t i = 0; i < P; ++i) {
+            trial[i] = theta[i] + stepScale * step[i];
+            // a constant phase exponent above one is not physical
+            if (circuit.isExponent(i))
+                trial[i] = std::min(trial[i], 0.0);
+        }
+
+        double trialCost = evaluate(trial, false);
+        if (trialCost < cost) {
+            bool small = cost - trialCost < 1e-9 * cost || stepNorm < 1e-10;
+            theta.swap(trial);
+            cost = evaluate(theta, true);
+            lambda = std::max(lambda / 10, 1e-12);
+            if (small) {
+                result.converged = true;
+                break;
+            }
+        } else {
+            // no step improves the fit any more: the fit stalled before it met the tolerance
+            lambda *= 10;
+            if (lambda > 1e12)
+                break;
+        }
+    }
+
+    result.chiSquare = cost;
+    result.parameters.resize(P);
+    for (size_t i = 0; i < P; ++i)
+        result.parameters[i] = std::exp(theta[i]);
+    return result;
+}
+
+/**
+ * A fixed set of worker threads running queued tasks.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (unsigned int i = 0; i < threadCount; ++i) {
+            m_workers.emplace_back([this]() {
+                for (;;) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        m_condition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+                        if (m_tasks.empty())
+                            return;
+                        task = std::move(m_tasks.front());
+                        m_tasks.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_condition.notify_all();
+        for (std::thread& worker : m_workers)
+            worker.join();
+    }
+
+    size_t size() const { return m_workers.size(); }
+
+    template <typename Function>
+    std::future<void> submit(Function function)
+    {
+        auto task = std::make_shared<std::packaged_task<void()>>(std::move(function));
+        std::future<void> future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push([task]() { (*task)(); });
+        }
+        m_condition.notify_one();
+        return future;
+    }
+
+private:
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stopping = false;
+};
+
+/**
+ * Fits a circuit to spectra using several starting points per spectrum, spread over a thread pool.
+ */
+class CircuitFitter {
+public:
+    CircuitFitter(const std::string& circuitDescription, int numberOfStarts, ThreadPool& pool)
+        : m_circuit(circuitDescription)
+        , m_numberOfStarts(std::max(1, numberOfStarts))
+        , m_pool(pool)
+    {
+    }
+
+    const EquivalentCircuit& circuit() const { return m_circuit; }
+
+    /**
+     * @brief fits a batch of spectra. Every (spectrum, start) pair is an independent task on the pool.
+     */
+    std::vector<CircuitFitResult> fit(const std::vector<std::vector<AisACData>>& spectra) const
+    {
+        std::vector<CircuitFitResult> candidates(spectra.size() * m_numberOfStarts);
+        std::vector<std::future<void>> pending;
+        pending.reserve(candidates.size());
+
+        for (size_t s = 0; s < spectra.size(); ++s) {
+            if (spectra[s].size() < m_circuit.parameterCount())
+                continue;
+            for (int start = 0; start < m_numberOfStarts; ++start) {
+                pending.push_back(m_pool.submit([this, &spectra, &candidates, s, start]() {
+                    candidates[s * m_numberOfStarts + start] = levenbergMarquardt(m_circuit, spectra[s], startingPoint(spectra[s], start));
+                }));
+            }
+        }
+        for (auto& future : pending)
+            future.get();
+
+        std::vector<CircuitFitResult> best(spectra.size());
+        for (size_t s = 0; s < spectra.size(); ++s) {
+            for (int start = 0; start < m_numberOfStarts; ++start) {
+                const CircuitFitResult& candidate = candidates[s * m_numberOfStarts + start];
+                if (candidate.chiSquare < best[s].chiSquare)
+                    best[s] = candidate;
+            }
+        }
+        return best;
+    }
+
+    CircuitFitResult fit(const std::vector<AisACData>& spectrum) const { return fit(std::vector<std::vector<AisACData>> { spectrum }).front(); }
+
+private:
+    std::vector<double> startingPoint(const std::vector<AisACData>& spectrum, int start) const
+    {
+        std::vector<double> guess = m_circuit.initialGuess(spectrum);
+        if (start == 0)
+            return guess;
+
+        // spread the other starts log-uniformly over three decades around the guess, reproducibly
+        std::mt19937 generator(static_cast<unsigned int>(start));
+        std::uniform_real_distribution<double> decades(-1.5, 1.5);
+        std::uniform_real_distribution<double> exponent(0.5, 1.0);
+        for (size_t i = 0; i < guess.size(); ++i)
+            guess[i] = m_circuit.isExponent(i) ? exponent(generator) : guess[i] * std::pow(10.0, decades(generator));
+        return guess;
+    }
+
+    EquivalentCircuit m_circuit;
+    int m_numberOfStarts;
+    ThreadPool& m_pool;
+};
+
+static std::vector<AisACData> syntheticRandlesSpectrum(double r0, double r1, double c1, double sigma, double noise, std::mt19937& generator)
+{
+    EquivalentCircuit randles("R0-p(R1-W1,C1)");
+    double parameters[] = { r0, r1, sigma, c1 };
+    std::normal_distribution<double> gaussian(0, noise);
+
+    std::vector<AisACData> spectrum;
+    for (double logFrequency = 5; logFrequency >= -1; logFrequency -= 0.1) {
+        double frequency = std::pow(10.0, logFrequency);
+        Complex z = randles.evaluate(2 * Pi * frequency, parameters, nullptr);
+        z *= Complex(1 + gaussian(generator), gaussian(generator));
+        AisACData point {};
+        point.frequency = frequency;
+        point.realImpedance = z.real();
+        point.imagImpedance = z.imag();
+        point.absoluteImpedance = std::abs(z);
+        point.phaseAngle = std::arg(z) * 180 / Pi;
+        spectrum.push_back(point);
+    }
+    return spectrum;
+}
+
+// Fits a batch of synthetic Randles spectra and reports throughput and parameter recovery
+static void runBenchmark()
+{
+    const int numberOfSpectra = 500;
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> decade(0, 1);
+
+    std::vector<std::vector<AisACData>> spectra;
+    std::vector<std::vector<double>> truth;
+    for (int i = 0; i < numberOfSpectra; ++i) {
+        double r0 = 5 * std::pow(10.0, decade(generator));
+        double r1 = 50 * std::pow(10.0, decade(generator));
+        double c1 = 1e-5 * std::pow(10.0, decade(generator));
+        double sigma = 20 * std::pow(10.0, decade(generator));
+        spectra.push_back(syntheticRandlesSpectrum(r0, r1, c1, sigma, 0.002, generator));
+        truth.push_back({ r0, r1, sigma, c1 });
+    }
+
+    ThreadPool pool;
+    CircuitFitter fitter("R0-p(R1-W1,C1)", 8, pool);
+
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<CircuitFitResult> results = fitter.fit(spectra);
+    qint64 elapsed = timer.elapsed();
+
+    double worstError = 0;
+    int unfitted = 0;
+    int stalled = 0;
+    for (int i = 0; i < numberOfSpectra; ++i) {
+        if (results[i].parameters.size() < truth[i].size()) {
+            ++unfitted;
+            continue;
+        }
+        if (!results[i].converged)
+            ++stalled;
+        for (size_t k = 0; k < truth[i].size(); ++k)
+            worstError = std::max(worstError, std::fabs(results[i].parameters[k] / truth[i][k] - 1));
+    }
+    qDebug() << "Fitted" << numberOfSpectra << "spectra of" << spectra.front().size() << "points with 8 starts each on" << pool.size() << "threads in"
+             << elapsed << "ms (" << static_cast<double>(elapsed) / numberOfSpectra << "ms per spectrum ), worst relative parameter error" << worstError
+             << "," << stalled << "fits did not converge," << unfitted << "spectra not fitted";
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    if (a.arguments().contains("--benchmark")) {
+        runBenchmark();
+        return 0;
+    }
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // 100kHz to 0.1Hz, 10 steps per decade, at 0V with 10mV amplitude
+    AisEISPotentiostaticElement eisElement(100000, 0.1, 10, 0, 0.01);
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendElement(eisElement, 10);
+
+    auto pool = std::make_shared<ThreadPool>();
+    auto fitter = std::make_shared<CircuitFitter>("R0-p(R1-W1,C1)", 8, *pool);
+    auto spectrum = std::make_shared<std::vector<AisACData>>();
+    const double endFrequency = eisElement.getEndFreq();
+
+    auto connectSignals = [=](const AisInstrumentHandler& handler) {
+        QObject::connect(&handler, &AisInstrumentHandler::activeACDataReady, [=](uint8_t channel, const AisACData& data) {
+            spectrum->push_back(data);
+            if (std::fabs(data.frequency - endFrequency) > 1e-3 * endFrequency)
+                return;
+
+            // the last frequency has arrived: fit this spectrum in the background and start collecting the next one
+            auto completed = std::make_shared<std::vector<AisACData>>();
+            completed->swap(*spectrum);
+            std::thread([fitter, completed, pool]() {
+                CircuitFitResult result = fitter->fit(*completed);
+                if (result.parameters.empty()) {
+                    qDebug() << "Spectrum too short to fit";
+                    return;
+                }
+                const auto& names = fitter->circuit().parameterNames();
+                QString text;
+                for (size_t i = 0; i < names.size(); ++i)
+                    text += QString("%1 = %2  ").arg(QString::fromStdString(names[i])).arg(result.parameters[i]);
+                qDebug().noquote() << text << "chi^2 =" << result.chiSquare << (result.converged ? "" : "(did not converge)");
+            }).detach();
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString& reason) {
+            qDebug() << "Experiment Stopped Signal " << channel << "Reason : " << reason;
+        });
+    };
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        connectSignals(handler);
+
+        auto error = handler.uploadExperimentToChannel(CHANNEL, experiment);
+        if (error) {
+            qDebug() << error.message();
+            return;
+        }
+        error = handler.startUploadedExperiment(CHANNEL);
+        if (error) {
+            qDebug() << error.message();
+        }
+    });
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << "Error: " << error.message();
+        return 0;
+    }
+
+    return a.exec();
+}
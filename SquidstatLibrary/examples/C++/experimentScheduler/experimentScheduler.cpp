@@ -0,0 +1,498 @@
+/**
+ * \example experimentScheduler.cpp
+ * This example shows how to run a large queue of short jobs on whichever channel is free, across every connected
+ * device, without polling AisInstrumentHandler::getFreeChannels.
+ *
+ * `ExperimentScheduler` reads the free channels of a device once, when the device is added, and from then on keeps
+ * track of them from AisInstrumentHandler::experimentStopped. Every time a channel is freed, or a job is submitted, the
+ * queue is dispatched straight away. Jobs are taken in submission order, but a job that fits no free channel does not
+ * hold back the jobs behind it. A job can be restricted to:
+ * - devices whose name starts with a model name, for example "Cycler",
+ * - channels that have a bipolar mode, see AisInstrumentHandler::hasBipolarMode,
+ * - a number of channels linked together with AisInstrumentHandler::setLinkedChannels, which only the cycler model
+ *   supports. The header does not say how to undo a link: calling setLinkedChannels with a single channel releases that
+ *   channel from its group, which the scheduler does for every channel of a linked job once it has stopped.
+ *
+ * When a job fails to start, the scheduler tells apart failures of the job from failures of the channel. A job that
+ * cannot be linked, or whose experiment the device rejects as invalid, fails without touching the channels. Any other
+ * failure takes the channel out of the schedule, and the job is tried on another channel, up to three times; a channel
+ * that turns out to be busy with an experiment of someone else rejoins the schedule when that experiment stops. A job
+ * that no channel of any added device could ever run fails once it has waited for the placement timeout, since a device
+ * that can run it may still connect until then.
+ *
+ * The scheduler reports how long jobs waited in the queue, how long channels stayed idle while jobs were waiting and
+ * how busy every channel was.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisOpenCircuitElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+/**
+ * What a job needs from the channel it runs on.
+ */
+struct JobConstraints {
+    QString model; ///< the start of the device name, empty for any device.
+    bool bipolar = false; ///< true if the channel must have a bipolar mode.
+    int linkedChannels = 1; ///< the number of channels to link together for the job.
+};
+
+/**
+ * A finished job.
+ */
+struct JobRecord {
+    int id;
+    QString deviceName;
+    uint8_t channel; ///< the channel the job ran on, the master channel for linked channels.
+    qint64 queueLatency; ///< the time from submission to start in milliseconds.
+    qint64 runTime; ///< the time from start to stop in milliseconds.
+    QString reason; ///< the reason the experiment stopped.
+};
+
+/**
+ * Summary statistics of the scheduler.
+ */
+struct SchedulerStatistics {
+    size_t queued = 0;
+    size_t running = 0;
+    size_t completed = 0;
+    size_t failed = 0; ///< jobs that could not be started, fit no channel or whose device disconnected.
+    size_t faultyChannels = 0; ///< channels taken out of the schedule because a job failed to start on them.
+    double meanQueueLatency = 0; ///< in milliseconds.
+    qint64 maxQueueLatency = 0; ///< in milliseconds.
+    double meanIdleGap = 0; ///< the mean time a channel stayed free while jobs were waiting, in milliseconds.
+    double utilization = 0; ///< the fraction of channel time spent running jobs, over all channels.
+};
+
+/**
+ * Dispatches jobs to the free channels of all added devices.
+ */
+class ExperimentScheduler {
+public:
+    using CompletionCallback = std::function<void(const JobRecord&)>;
+
+    static constexpr int MaxStartAttempts = 3;
+
+    /**
+     * @brief whether a device can link channels, which only the cycler model can.
+     */
+    static bool supportsLinking(const QString& deviceName) { return deviceName.startsWith("Cycler"); }
+
+    /**
+     * @param placementTimeout the time in milliseconds a job that fits no channel of any added device waits before it fails.
+     */
+    explicit ExperimentScheduler(int placementTimeout = 30000)
+        : m_placementTimeout(placementTimeout)
+    {
+        m_clock.start();
+        m_expiryTimer.setInterval(1000);
+        QObject::connect(&m_expiryTimer, &QTimer::timeout, [this]() { expireUnplaceable(); });
+        m_expiryTimer.start();
+    }
+
+    void setCompletionCallback(CompletionCallback callback) { m_completionCallback = std::move(callback); }
+
+    /**
+     * @brief adds a device, and starts dispatching jobs to its free channels.
+     */
+    void addDevice(const QString& deviceName, const AisInstrumentHandler& handler)
+    {
+        Device& device = m_devices[deviceName];
+        device.handler = &handler;
+        for (uint8_t channel : handler.getFreeChannels()) {
+            device.freeChannels.insert(channel);
+            device.channels[channel].since = m_clock.elapsed();
+        }
+
+        device.connection = QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [this, deviceName](uint8_t channel, const QString& reason) {
+            onStopped(deviceName, channel, reason);
+        });
+        dispatch();
+    }
+
+    /**
+     * @brief removes a device, for example once it has disconnected. The jobs that were running on it count as failed.
+     */
+    void removeDevice(const QString& deviceName)
+    {
+        auto it = m_devices.find(deviceName);
+        if (it == m_devices.end())
+            return;
+        QObject::disconnect(it->second.connection);
+        m_failed += it->second.running.size();
+        for (const auto& channel : it->second.channels) {
+            m_retiredChannelTime += m_clock.elapsed() - channel.second.since;
+            m_retiredBusyTime += channel.second.busyTime;
+        }
+        m_devices.erase(it);
+    }
+
+    /**
+     * @brief queues a job and dispatches it if a suitable channel is free.
+     * @return the id of the job.
+     */
+    int submit(std::shared_ptr<AisExperiment> experiment, const JobConstraints& constraints = JobConstraints())
+    {
+        int id = m_nextId++;
+        m_queue.push_back({ id, std::move(experiment), constraints, m_clock.elapsed() });
+        dispatch();
+        return id;
+    }
+
+    bool idle() const
+    {
+        if (!m_queue.empty())
+            return false;
+        for (const auto& device : m_devices) {
+            if (!device.second.running.empty())
+                return false;
+        }
+        return true;
+    }
+
+    SchedulerStatistics statistics() const
+    {
+        SchedulerStatistics result;
+        result.queued = m_queue.size();
+        result.completed = m_completed;
+        result.failed = m_failed;
+        result.meanQueueLatency = m_started > 0 ? static_cast<double>(m_totalQueueLatency) / m_started : 0;
+        result.maxQueueLatency = m_maxQueueLatency;
+        result.meanIdleGap = m_idleGaps > 0 ? static_cast<double>(m_totalIdleGap) / m_idleGaps : 0;
+
+        qint64 now = m_clock.elapsed();
+        qint64 channelTime = m_retiredChannelTime;
+        qint64 busyTime = m_retiredBusyTime;
+        for (const auto& device : m_devices) {
+            result.running += device.second.running.size();
+            result.faultyChannels += device.second.faultyChannels.size();
+            for (const auto& channel : device.second.channels) {
+                channelTime += now - channel.second.since;
+                busyTime += channel.second.busyTime;
+            }
+            // the jobs still running count up to now
+            for (const auto& job : device.second.running)
+                busyTime += (now - job.second.started) * static_cast<qint64>(job.second.channels.size());
+        }
+        result.utilization = channelTime > 0 ? static_cast<double>(busyTime) / channelTime : 0;
+        return result;
+    }
+
+private:
+    struct PendingJob {
+        int id;
+        std::shared_ptr<AisExperiment> experiment;
+        JobConstraints constraints;
+        qint64 submitted;
+        int attempts = 0;
+    };
+
+    struct RunningJob {
+        int id;
+        std::vector<uint8_t> channels;
+        qint64 submitted;
+        qint64 started;
+    };
+
+    struct ChannelUsage {
+        qint64 since = 0; ///< when the channel was added to the scheduler.
+        qint64 busyTime = 0;
+        qint64 freedWithWork = -1; ///< when the channel was freed while jobs were waiting, -1 otherwise.
+    };
+
+    enum class StartResult {
+        Started,
+        ChannelFailed, ///< the channels are out of the schedule, the job can be tried elsewhere.
+        JobFailed, ///< the job would fail on any channel.
+    };
+
+    struct Device {
+        const AisInstrumentHandler* handler = nullptr;
+        std::set<uint8_t> freeChannels;
+        std::set<uint8_t> faultyChannels;
+        std::map<uint8_t, RunningJob> running; ///< by master channel.
+        std::map<uint8_t, ChannelUsage> channels;
+        QMetaObject::Connection connection;
+    };
+
+    static bool fitsDevice(const QString& deviceName, const JobConstraints& constraints)
+    {
+        if (!constraints.model.isEmpty() && !deviceName.startsWith(constraints.model))
+            return false;
+        return constraints.linkedChannels <= 1 || supportsLinking(deviceName);
+    }
+
+    // the free channels of a device that a job can run on, or an empty list if it does not fit there now
+    std::vector<uint8_t> findChannels(const QString& deviceName, const Device& device, const JobConstraints& constraints) const
+    {
+        if (!fitsDevice(deviceName, constraints))
+            return {};
+
+        std::vector<uint8_t> channels;
+        for (uint8_t channel : device.freeChannels) {
+            if (constraints.bipolar && !device.handler->hasBipolarMode(channel))
+                continue;
+            channels.push_back(channel);
+            if (static_cast<int>(channels.size()) == std::max(1, constraints.linkedChannels))
+                return channels;
+        }
+        return {};
+    }
+
+    // whether a device has enough channels for the job, free or not
+    bool canEverRun(const QString& deviceName, const Device& device, const JobConstraints& constraints) const
+    {
+        if (!fitsDevice(deviceName, constraints))
+            return false;
+        int suitable = 0;
+        for (uint8_t channel = 0; channel < device.handler->getNumberOfChannels(); ++channel) {
+            if (device.faultyChannels.count(channel) == 0 && (!constraints.bipolar || device.handler->hasBipolarMode(channel)))
+                ++suitable;
+        }
+        return suitable >= std::max(1, constraints.linkedChannels);
+    }
+
+    // starts the job on the first free channels that fit it
+    // @return true if the job leaves the queue, because it started or because it failed to start too many times
+    bool place(PendingJob& job)
+    {
+        while (true) {
+            auto entry = m_devices.begin();
+            std::vector<uint8_t> channels;
+            for (; entry != m_devices.end(); ++entry) {
+                channels = findChannels(entry->first, entry->second, job.constraints);
+                if (!channels.empty())
+                    break;
+            }
+            if (entry == m_devices.end())
+                return false;
+            StartResult result = start(entry->first, entry->second, job, channels);
+            if (result == StartResult::Started)
+                return true;
+            if (result == StartResult::JobFailed) {
+                ++m_failed;
+                return true;
+            }
+            // the channels are out of the schedule now, so the next attempt runs elsewhere
+            if (++job.attempts >= MaxStartAttempts) {
+                qDebug() << "Job" << job.id << "failed to start" << job.attempts << "times";
+                ++m_failed;
+                return true;
+            }
+        }
+    }
+
+    void dispatch()
+    {
+        for (auto job = m_queue.begin(); job != m_queue.end();) {
+            job = place(*job) ? m_queue.erase(job) : job + 1;
+
+            // stop looking once every channel is taken
+            bool anyFree = false;
+            for (const auto& entry : m_devices)
+                anyFree |= !entry.second.freeChannels.empty();
+            if (!anyFree)
+                break;
+        }
+    }
+
+    void expireUnplaceable()
+    {
+        qint64 now = m_clock.elapsed();
+        for (auto job = m_queue.begin(); job != m_queue.end();) {
+            bool expired = now - job->submitted >= m_placementTimeout;
+            for (auto entry = m_devices.begin(); expired && entry != m_devices.end(); ++entry)
+                expired = !canEverRun(entry->first, entry->second, job->constraints);
+            if (!expired) {
+                ++job;
+                continue;
+            }
+            qDebug() << "Job" << job->id << "fits no channel of any device";
+            ++m_failed;
+            job = m_queue.erase(job);
+        }
+    }
+
+    // errors that the job would get on any channel
+    static bool isJobError(const AisErrorCode& error)
+    {
+        return error == AisErrorCode::InvalidParameters || error == AisErrorCode::ExperimentIsEmpty || error == AisErrorCode::FeatureNotSupported;
+    }
+
+    // linking a channel on its own releases it from the group it was linked into
+    static void unlink(const AisInstrumentHandler& handler, const std::vector<uint8_t>& channels)
+    {
+        if (channels.size() <= 1)
+            return;
+        for (uint8_t channel : channels)
+            handler.setLinkedChannels({ channel });
+    }
+
+    // only a failure that comes from the channels takes them out of the schedule
+    StartResult start(const QString& deviceName, Device& device, const PendingJob& job, const std::vector<uint8_t>& channels)
+    {
+        const AisInstrumentHandler& handler = *device.handler;
+        int master = channels.front();
+        if (channels.size() > 1) {
+            master = handler.setLinkedChannels(channels);
+            if (master < 0) {
+                qDebug() << "Job" << job.id << "could not link" << channels.size() << "channels on" << deviceName;
+                return StartResult::JobFailed;
+            }
+        }
+
+        AisErrorCode error = handler.uploadExperimentToChannel(master, job.experiment);
+        if (!error)
+            error = handler.startUploadedExperiment(master);
+        if (error) {
+            qDebug() << "Job" << job.id << "failed on" << deviceName << "channel" << master << ":" << error.message();
+            unlink(handler, channels);
+            if (isJobError(error))
+                return StartResult::JobFailed;
+            for (uint8_t channel : channels) {
+                device.freeChannels.erase(channel);
+                // a busy channel is not faulty, and is free again once the experiment on it stops
+                if (error != AisErrorCode::BusyChannel)
+                    device.faultyChannels.insert(channel);
+            }
+            return StartResult::ChannelFailed;
+        }
+
+        qint64 now = m_clock.elapsed();
+        for (uint8_t channel : channels) {
+            device.freeChannels.erase(channel);
+            ChannelUsage& usage = device.channels[channel];
+            if (usage.freedWithWork >= 0) {
+                m_totalIdleGap += now - usage.freedWithWork;
+                ++m_idleGaps;
+                usage.freedWithWork = -1;
+            }
+        }
+        device.running[static_cast<uint8_t>(master)] = { job.id, channels, job.submitted, now };
+
+        qint64 latency = now - job.submitted;
+        m_totalQueueLatency += latency;
+        m_maxQueueLatency = std::max(m_maxQueueLatency, latency);
+        ++m_started;
+        return StartResult::Started;
+    }
+
+    void onStopped(const QString& deviceName, uint8_t channel, const QString& reason)
+    {
+        auto deviceIt = m_devices.find(deviceName);
+        if (deviceIt == m_devices.end())
+            return;
+        Device& device = deviceIt->second;
+        auto jobIt = device.running.find(channel);
+        if (jobIt == device.running.end()) {
+            // a channel that was busy with an experiment of someone else, when the device was added or a job tried it
+            if (device.faultyChannels.count(channel) == 0 && device.freeChannels.count(channel) == 0) {
+                if (device.channels.find(channel) == device.channels.end())
+                    device.channels[channel].since = m_clock.elapsed();
+                device.freeChannels.insert(channel);
+                dispatch();
+            }
+            return;
+        }
+
+        RunningJob job = jobIt->second;
+        device.running.erase(jobIt);
+        qint64 now = m_clock.elapsed();
+
+        unlink(*device.handler, job.channels);
+        for (uint8_t member : job.channels) {
+            device.freeChannels.insert(member);
+            ChannelUsage& usage = device.channels[member];
+            usage.busyTime += now - job.started;
+            usage.freedWithWork = m_queue.empty() ? -1 : now;
+        }
+        ++m_completed;
+
+        if (m_completionCallback)
+            m_completionCallback({ job.id, deviceName, channel, job.started - job.submitted, now - job.started, reason });
+        dispatch();
+    }
+
+    QElapsedTimer m_clock;
+    int m_placementTimeout;
+    QTimer m_expiryTimer;
+    std::map<QString, Device> m_devices;
+    std::deque<PendingJob> m_queue;
+    CompletionCallback m_completionCallback;
+    int m_nextId = 1;
+
+    size_t m_started = 0;
+    size_t m_completed = 0;
+    size_t m_failed = 0;
+    qint64 m_totalQueueLatency = 0;
+    qint64 m_maxQueueLatency = 0;
+    qint64 m_totalIdleGap = 0;
+    size_t m_idleGaps = 0;
+    qint64 m_retiredChannelTime = 0;
+    qint64 m_retiredBusyTime = 0;
+};
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+    auto scheduler = std::make_shared<ExperimentScheduler>();
+
+    // a thousand 5 second open circuit measurements, every tenth of them on a bipolar channel; those fail after 30
+    // seconds if no connected device has a bipolar channel
+    AisOpenCircuitElement ocpElement(5, 0.5);
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendElement(ocpElement, 1);
+    for (int i = 0; i < 1000; ++i) {
+        JobConstraints constraints;
+        constraints.bipolar = i % 10 == 0;
+        scheduler->submit(experiment, constraints);
+    }
+
+    scheduler->setCompletionCallback([](const JobRecord& record) {
+        qDebug() << "Job" << record.id << "finished on" << record.deviceName << "channel" << record.channel << "after waiting" << record.queueLatency << "ms";
+    });
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        scheduler->addDevice(deviceName, tracker->getInstrumentHandler(deviceName));
+    });
+    QObject::connect(tracker, &AisDeviceTracker::deviceDisconnected, &a, [=](const QString& deviceName) {
+        scheduler->removeDevice(deviceName);
+    });
+
+    // report every 10 seconds, and quit once all jobs are done
+    QTimer reportTimer;
+    QObject::connect(&reportTimer, &QTimer::timeout, &a, [=, &a]() {
+        SchedulerStatistics stats = scheduler->statistics();
+        qDebug() << "queued:" << stats.queued << "running:" << stats.running << "completed:" << stats.completed << "failed:" << stats.failed
+                 << "queue latency mean:" << stats.meanQueueLatency << "ms max:" << stats.maxQueueLatency << "ms idle gap:" << stats.meanIdleGap
+                 << "ms utilization:" << stats.utilization * 100 << "% faulty channels:" << stats.faultyChannels;
+        if (scheduler->idle())
+            a.quit();
+    });
+    reportTimer.start(10000);
+
+    if (tracker->connectAllPluggedInDevices() == 0) {
+        qDebug() << "Error: no device found";
+        return 0;
+    }
+
+    return a.exec();
+}
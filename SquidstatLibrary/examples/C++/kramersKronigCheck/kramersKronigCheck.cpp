@@ -0,0 +1,325 @@
+/**
+ * \example kramersKronigCheck.cpp
+ * This example shows how to validate an EIS spectrum with the linear Kramers-Kronig test (Lin-KK) while it is being measured,
+ * so that an invalid measurement can be flagged before the next step of the experiment starts.
+ *
+ * Lin-KK fits the spectrum with a series resistance, an inductance and a chain of RC elements whose time constants are
+ * spread logarithmically over the frequency range. The time constants are fixed, which makes the fit linear. Because the
+ * frequency range is known from the `AisEISPotentiostaticElement` before any data arrives, the time constants are fixed up
+ * front and every new point is rotated into a QR factorization of the fit with Givens rotations. This costs O(M<sup>2</sup>)
+ * per point for M fit parameters, instead of a full O(N M<sup>2</sup>) refit, and needs no prior, so it works the same for
+ * spectra of a few ohms and of megaohms.
+ *
+ * Run the example with "--benchmark" to validate synthetic spectra from 10 ohms to 10 megaohms without an instrument
+ * attached and report throughput.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisEISPotentiostaticElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <random>
+#include <vector>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+#define CHANNEL 0
+
+static constexpr double Pi = 3.14159265358979323846;
+
+/**
+ * The Lin-KK residuals of one frequency, relative to the impedance magnitude.
+ */
+struct KramersKronigResidual {
+    double frequency;
+    double real;
+    double imag;
+};
+
+/**
+ * Incrementally fits the Lin-KK model to a spectrum and reports its residuals.
+ */
+class KramersKronigValidator {
+public:
+    /**
+     * @param startFrequency the first frequency of the spectrum in Hz.
+     * @param endFrequency the last frequency of the spectrum in Hz.
+     * @param rcPerDecade the number of RC elements per decade of frequency.
+     */
+    KramersKronigValidator(double startFrequency, double endFrequency, double rcPerDecade = 3)
+    {
+        double minOmega = 2 * Pi * std::min(startFrequency, endFrequency);
+        double maxOmega = 2 * Pi * std::max(startFrequency, endFrequency);
+        int rcCount = std::max(2, static_cast<int>(std::ceil(std::log10(maxOmega / minOmega) * rcPerDecade)) + 1);
+
+        // time constants from 1/maxOmega to 1/minOmega, as in Schoenleber et al.
+        for (int k = 0; k < rcCount; ++k)
+            m_tau.push_back(std::pow(10.0, std::log10(1 / maxOmega) + k * std::log10(maxOmega / minOmega) / (rcCount - 1)));
+
+        // parameters: R0, R1..RM, L
+        m_size = m_tau.size() + 2;
+        m_row.resize(m_size);
+        reset();
+    }
+
+    void reset()
+    {
+        m_theta.assign(m_size, 0.0);
+        m_r.assign(m_size * m_size, 0.0);
+        m_z.assign(m_size, 0.0);
+        m_points.clear();
+    }
+
+    size_t parameterCount() const { return m_size; }
+
+    /**
+     * @brief adds a point to the fit.
+     * @return the residual of the point against the fit before it was added, which is an early indication of an outlier.
+     */
+    KramersKronigResidual addPoint(const AisACData& data)
+    {
+        double omega = 2 * Pi * data.frequency;
+        double weight = 1.0 / std::max(std::hypot(data.realImpedance, data.imagImpedance), 1e-12);
+
+        KramersKronigResidual predicted = residual(data);
+        m_points.push_back(data);
+
+        // the real and imaginary parts are two rows of the linear problem
+        m_row[0] = weight;
+        for (size_t k = 0; k < m_tau.size(); ++k) {
+            double wt = omega * m_tau[k];
+            m_row[k + 1] = weight / (1 + wt * wt);
+        }
+        m_row[m_size - 1] = 0;
+        update(weight * data.realImpedance);
+
+        m_row[0] = 0;
+        for (size_t k = 0; k < m_tau.size(); ++k) {
+            double wt = omega * m_tau[k];
+            m_row[k + 1] = -weight * wt / (1 + wt * wt);
+        }
+        m_row[m_size - 1] = weight * omega;
+        update(weight * data.imagImpedance);
+
+        solve();
+        return predicted;
+    }
+
+    /**
+     * @brief the residuals of every point added so far against the current fit.
+     */
+    std::vector<KramersKronigResidual> residuals() const
+    {
+        std::vector<KramersKronigResidual> result;
+        result.reserve(m_points.size());
+        for (const AisACData& point : m_points)
+            result.push_back(residual(point));
+        return result;
+    }
+
+    /**
+     * @brief the largest relative residual of any point, real or imaginary.
+     */
+    double maxResidual() const
+    {
+        double worst = 0;
+        for (const KramersKronigResidual& r : residuals())
+            worst = std::max({ worst, std::fabs(r.real), std::fabs(r.imag) });
+        return worst;
+    }
+
+private:
+    KramersKronigResidual residual(const AisACData& data) const
+    {
+        double omega = 2 * Pi * data.frequency;
+        std::complex<double> model(m_theta[0], omega * m_theta[m_size - 1]);
+        for (size_t k = 0; k < m_tau.size(); ++k)
+            model += m_theta[k + 1] / std::complex<double>(1, omega * m_tau[k]);
+
+        double magnitude = std::max(std::hypot(data.realImpedance, data.imagImpedance), 1e-12);
+        return { data.frequency, (data.realImpedance - model.real()) / magnitude, (data.imagImpedance - model.imag()) / magnitude };
+    }
+
+    // rotates the row in m_row with the target value y into the upper triangular R and the right hand side z
+    void update(double y)
+    {
+        const size_t n = m_size;
+        double* a = m_row.data();
+        double* R = m_r.data();
+
+        for (size_t i = 0; i < n; ++i) {
+            if (a[i] == 0)
+                continue;
+            double* row = R + i * n;
+            double h = std::hypot(row[i], a[i]);
+            double c = row[i] / h;
+            double s = a[i] / h;
+            row[i] = h;
+            for (size_t j = i + 1; j < n; ++j) {
+                double rij = row[j];
+                row[j] = c * rij + s * a[j];
+                a[j] = c * a[j] - s * rij;
+            }
+            double zi = m_z[i];
+            m_z[i] = c * zi + s * y;
+            y = c * y - s * zi;
+        }
+    }
+
+    // solves R theta = z by back substitution; parameters that the points so far do not determine are left at 0
+    void solve()
+    {
+        const size_t n = m_size;
+        const double* R = m_r.data();
+        double largest = 0;
+        for (size_t i = 0; i < n; ++i)
+            largest = std::max(largest, std::fabs(R[i * n + i]));
+
+        for (size_t i = n; i-- > 0;) {
+            const double* row = R + i * n;
+            if (std::fabs(row[i]) <= 1e-12 * largest) {
+                m_theta[i] = 0;
+                continue;
+            }
+            double sum = m_z[i];
+            for (size_t j = i + 1; j < n; ++j)
+                sum -= row[j] * m_theta[j];
+            m_theta[i] = sum / row[i];
+        }
+    }
+
+    std::vector<double> m_tau;
+    size_t m_size;
+    std::vector<double> m_theta;
+    std::vector<double> m_r;
+    std::vector<double> m_z;
+    std::vector<double> m_row;
+    std::vector<AisACData> m_points;
+};
+
+// Validates synthetic Randles spectra from 10 ohms to 10 megaohms, some of them with drift added, and reports throughput
+static void runBenchmark()
+{
+    const int numberOfSpectra = 2000;
+    const double startFrequency = 100000;
+    const double endFrequency = 0.1;
+    const double scales[] = { 1, 100, 10000, 100000 };
+    std::mt19937 generator(7);
+    std::normal_distribution<double> noise(0, 0.001);
+
+    std::vector<std::vector<AisACData>> spectra(numberOfSpectra);
+    for (int s = 0; s < numberOfSpectra; ++s) {
+        // every fourth spectrum drifts during the measurement, which violates Kramers-Kronig, and the impedance scale
+        // changes with every group of four, with the same time constant
+        double drift = s % 4 == 3 ? 0.2 : 0.0;
+        double scale = scales[(s / 4) % 4];
+        int index = 0;
+        for (double logFrequency = 5; logFrequency >= -1; logFrequency -= 0.1, ++index) {
+            double frequency = std::pow(10.0, logFrequency);
+            double omega = 2 * Pi * frequency;
+            double r1 = 100 * scale * (1 + drift * index / 60.0);
+            std::complex<double> z = 10.0 * scale + r1 / std::complex<double>(1, omega * r1 * 1e-5 / scale);
+            z *= std::complex<double>(1 + noise(generator), noise(generator));
+            AisACData point {};
+            point.frequency = frequency;
+            point.realImpedance = z.real();
+            point.imagImpedance = z.imag();
+            spectra[s].push_back(point);
+        }
+    }
+
+    KramersKronigValidator validator(startFrequency, endFrequency);
+    int flagged = 0;
+    int wronglyFlagged = 0;
+    size_t points = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (int s = 0; s < numberOfSpectra; ++s) {
+        validator.reset();
+        for (const AisACData& point : spectra[s])
+            validator.addPoint(point);
+        points += spectra[s].size();
+        if (validator.maxResidual() > 0.01) {
+            ++flagged;
+            if (s % 4 != 3)
+                ++wronglyFlagged;
+        }
+    }
+    qint64 elapsed = timer.nsecsElapsed();
+
+    qDebug() << "Validated" << numberOfSpectra << "spectra (" << points << "points," << validator.parameterCount() << "parameters ) in" << elapsed / 1e6 << "ms:"
+             << points / (elapsed / 1e9) << "points/s," << flagged << "flagged, expected" << numberOfSpectra / 4 << "," << wronglyFlagged << "valid spectra flagged";
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    if (a.arguments().contains("--benchmark")) {
+        runBenchmark();
+        return 0;
+    }
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // 100kHz to 0.1Hz, 10 steps per decade, at 0V with 10mV amplitude
+    AisEISPotentiostaticElement eisElement(100000, 0.1, 10, 0, 0.01);
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendElement(eisElement, 1);
+
+    // a spectrum with any residual above 1% is considered invalid
+    const double threshold = 0.01;
+    const double endFrequency = eisElement.getEndFreq();
+    auto validator = std::make_shared<KramersKronigValidator>(eisElement.getStartFreq(), endFrequency);
+
+    auto connectSignals = [=](const AisInstrumentHandler& handler) {
+        QObject::connect(&handler, &AisInstrumentHandler::activeACDataReady, [=](uint8_t channel, const AisACData& data) {
+            KramersKronigResidual predicted = validator->addPoint(data);
+            qDebug() << "Frequency: " << data.frequency << " predicted residual real: " << predicted.real << " imag: " << predicted.imag;
+
+            if (std::fabs(data.frequency - endFrequency) > 1e-3 * endFrequency)
+                return;
+
+            double worst = validator->maxResidual();
+            if (worst > threshold)
+                qDebug() << "Spectrum fails the Kramers-Kronig check, largest residual" << worst << "- consider measuring it again";
+            else
+                qDebug() << "Spectrum passes the Kramers-Kronig check, largest residual" << worst;
+            validator->reset();
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString& reason) {
+            qDebug() << "Experiment Stopped Signal " << channel << "Reason : " << reason;
+        });
+    };
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        connectSignals(handler);
+
+        auto error = handler.uploadExperimentToChannel(CHANNEL, experiment);
+        if (error) {
+            qDebug() << error.message();
+            return;
+        }
+        error = handler.startUploadedExperiment(CHANNEL);
+        if (error) {
+            qDebug() << error.message();
+        }
+    });
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << "Error: " << error.message();
+        return 0;
+    }
+
+    return a.exec();
+}
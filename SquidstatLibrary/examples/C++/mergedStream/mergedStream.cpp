@@ -0,0 +1,249 @@
+/**
+ * \example mergedStream.cpp
+ * This example shows how to turn the DC data of several channels, on one or more instruments, into a single stream of
+ * samples in time order.
+ *
+ * Every AisInstrumentHandler emits AisInstrumentHandler::activeDCDataReady on its own, and the samples of the channels
+ * arrive interleaved in whatever order the instruments send them. `MergedDCStream` keeps a buffer per channel, in which
+ * the samples are already in time order, and a heap that holds only the first sample of each buffer. The earliest of
+ * those is handed on as soon as every running channel has a sample waiting, which is the plain k-way merge and costs a
+ * logarithm of the number of channels per sample.
+ *
+ * A channel that falls silent would hold up the merge. With a bounded lateness, a sample is also handed on once it is
+ * that much older than the newest sample seen on any channel, and a sample that arrives after a later one was already
+ * handed on is counted as late and left out, so the stream stays in order.
+ *
+ * A channel is only waited for once the merge knows it runs. Register every channel with MergedDCStream::addChannel
+ * right after its experiment is started: a channel that is first seen with its first sample may find the samples of the
+ * other channels handed on already, and lose its first samples as late.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantPotElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
+#include <vector>
+
+/**
+ * A DC sample with the channel it came from, on the UTC time base shared by all channels.
+ */
+struct MergedDCSample {
+    QString deviceName;
+    uint8_t channel;
+    double time; ///< in seconds since the Unix Epoch.
+    AisDCData data;
+};
+
+/**
+ * Merges the DC data of several channels into one stream in time order.
+ */
+class MergedDCStream {
+public:
+    using SampleReady = std::function<void(const MergedDCSample&)>;
+
+    /**
+     * @param maxLateness the seconds a sample waits for the other channels at most, measured against the newest sample
+     * of any channel. Samples that arrive later than that are left out.
+     */
+    explicit MergedDCStream(SampleReady sampleReady, double maxLateness = 0.5)
+        : m_sampleReady(std::move(sampleReady))
+        , m_maxLateness(maxLateness)
+    {
+    }
+
+    void addDevice(const QString& deviceName, const AisInstrumentHandler& handler)
+    {
+        const AisInstrumentHandler* source = &handler;
+        QObject::connect(source, &AisInstrumentHandler::activeDCDataReady, [=](uint8_t channel, const AisDCData& data) {
+            Source& state = this->source(deviceName, channel);
+            if (!state.anchored) {
+                state.startTime = source->getExperimentUTCStartTime(channel);
+                state.anchored = true;
+            }
+            // a channel that was not registered is waited for from its first sample on
+            setRunning(state);
+            push(state, { deviceName, channel, state.startTime + data.timestamp, data });
+        });
+        QObject::connect(source, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString&) {
+            Source& state = this->source(deviceName, channel);
+            // the next experiment on the channel has its own start time
+            state.anchored = false;
+            if (!state.running)
+                return;
+            // a stopped channel sends nothing more, so the merge no longer waits for it
+            state.running = false;
+            if (state.buffer.empty())
+                --m_waiting;
+            drain();
+        });
+    }
+
+    /**
+     * @brief makes the merge wait for a channel before its first sample arrives. Call it once the experiment on the
+     * channel is started.
+     */
+    void addChannel(const QString& deviceName, uint8_t channel) { setRunning(source(deviceName, channel)); }
+
+    /**
+     * @brief hands on all waiting samples, in time order, without waiting for the other channels.
+     */
+    void flush()
+    {
+        while (!m_heads.empty())
+            emitEarliest();
+    }
+
+    /**
+     * @brief the number of samples left out because they arrived after a later sample was handed on.
+     */
+    uint64_t lateSamples() const { return m_late; }
+
+private:
+    struct Source {
+        std::deque<MergedDCSample> buffer;
+        double startTime = 0;
+        bool anchored = false; ///< true once the start time of the running experiment is known.
+        bool running = false;
+    };
+
+    struct Head {
+        double time;
+        uint64_t sequence; ///< keeps samples with the same time in the order they arrived.
+        Source* source;
+
+        bool operator>(const Head& other) const { return time != other.time ? time > other.time : sequence > other.sequence; }
+    };
+
+    Source& source(const QString& deviceName, uint8_t channel) { return m_sources[{ deviceName, channel }]; }
+
+    void setRunning(Source& state)
+    {
+        if (state.running)
+            return;
+        state.running = true;
+        if (state.buffer.empty())
+            ++m_waiting;
+    }
+
+    void push(Source& state, MergedDCSample&& sample)
+    {
+        if (m_emittedAny && sample.time < m_emitted) {
+            ++m_late;
+            return;
+        }
+        if (!m_receivedAny || sample.time > m_newest)
+            m_newest = sample.time;
+        m_receivedAny = true;
+
+        state.buffer.push_back(std::move(sample));
+        if (state.buffer.size() == 1) {
+            m_heads.push({ state.buffer.front().time, m_sequence++, &state });
+            --m_waiting;
+        }
+        drain();
+    }
+
+    void drain()
+    {
+        while (!m_heads.empty() && (m_waiting == 0 || m_heads.top().time <= m_newest - m_maxLateness))
+            emitEarliest();
+    }
+
+    void emitEarliest()
+    {
+        Source* state = m_heads.top().source;
+        m_heads.pop();
+        MergedDCSample sample = std::move(state->buffer.front());
+        state->buffer.pop_front();
+        if (!state->buffer.empty())
+            m_heads.push({ state->buffer.front().time, m_sequence++, state });
+        else if (state->running)
+            ++m_waiting;
+
+        m_emitted = sample.time;
+        m_emittedAny = true;
+        m_sampleReady(sample);
+    }
+
+    SampleReady m_sampleReady;
+    double m_maxLateness;
+    // std::map keeps the address of every source, which the heads point to
+    std::map<std::pair<QString, uint8_t>, Source> m_sources;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> m_heads;
+    int m_waiting = 0; ///< the running channels with an empty buffer.
+    uint64_t m_sequence = 0;
+    double m_newest = 0;
+    bool m_receivedAny = false;
+    double m_emitted = 0;
+    bool m_emittedAny = false;
+    uint64_t m_late = 0;
+};
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // hold 0.1V for 60 seconds, sampled every 10ms, on every channel of every instrument
+    AisConstantPotElement cvElement(0.1, 0.01, 60);
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendElement(cvElement, 1);
+
+    // the downstream processor sees one stream, and only checks here that it is in order
+    auto count = std::make_shared<uint64_t>(0);
+    auto outOfOrder = std::make_shared<uint64_t>(0);
+    auto previous = std::make_shared<double>(0);
+    auto stream = std::make_shared<MergedDCStream>([=](const MergedDCSample& sample) {
+        if (*count > 0 && sample.time < *previous)
+            ++*outOfOrder;
+        *previous = sample.time;
+        if (++*count % 1000 == 0)
+            qDebug() << *count << "samples, latest from" << sample.deviceName << "channel" << sample.channel << "at" << QString::number(sample.time, 'f', 6);
+    });
+
+    auto running = std::make_shared<int>(0);
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        stream->addDevice(deviceName, handler);
+
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString& reason) {
+            qDebug() << deviceName << "Experiment Stopped Signal " << channel << "Reason : " << reason;
+            if (--*running > 0)
+                return;
+            stream->flush();
+            qDebug() << *count << "samples merged," << *outOfOrder << "out of order," << stream->lateSamples() << "left out as late";
+            QCoreApplication::quit();
+        });
+
+        for (uint8_t channel : handler.getFreeChannels()) {
+            auto error = handler.uploadExperimentToChannel(channel, experiment);
+            if (!error)
+                error = handler.startUploadedExperiment(channel);
+            if (error) {
+                qDebug() << deviceName << "channel" << channel << ":" << error.message();
+                continue;
+            }
+            stream->addChannel(deviceName, channel);
+            ++*running;
+        }
+    });
+
+    if (tracker->connectAllPluggedInDevices() == 0) {
+        qDebug() << "Error: no device found";
+        return 0;
+    }
+
+    return a.exec();
+}
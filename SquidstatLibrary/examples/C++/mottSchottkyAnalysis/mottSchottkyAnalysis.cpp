@@ -0,0 +1,200 @@
+/**
+ * \example mottSchottkyAnalysis.cpp
+ * This example shows how to extract the space-charge capacitance from an `AisMottSchottkyElement` while it is running.
+ *
+ * Each AC point received through AisInstrumentHandler::activeACDataReady is converted to a series capacitance
+ * C = -1 / (2&pi; f Z''), and C<sup>-2</sup> is added to a running linear fit against the DC potential of that frequency.
+ * Points are grouped into potential steps using the voltage step of the element. From the fit of each frequency the
+ * flat-band potential and the doping density are updated after every point:
+ * - E<sub>fb</sub> = -intercept / slope - kT/e
+ * - N = 2 / (e &epsilon; &epsilon;<sub>0</sub> A<sup>2</sup> |slope|)
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisMottSchottkyElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+
+#include <cmath>
+#include <functional>
+#include <vector>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+#define CHANNEL 0
+
+/**
+ * One AC point converted to capacitance, together with the current fit of its frequency.
+ */
+struct MottSchottkyPoint {
+    int potentialStep; ///< the index of the potential step this point belongs to.
+    double potential; ///< the DC working electrode potential in volts.
+    double frequency; ///< the frequency in Hz.
+    double capacitance; ///< the series capacitance in farads.
+    double inverseSquareCapacitance; ///< C^-2 in F^-2.
+    double flatBandPotential; ///< the flat-band potential from the fit of this frequency, in volts.
+    double dopingDensity; ///< the doping density from the fit of this frequency, in cm^-3.
+    bool fitValid; ///< false until the frequency has points on at least two potential steps.
+};
+
+/**
+ * Converts Mott-Schottky AC data to C^-2 and keeps a linear fit of C^-2 versus potential per frequency.
+ */
+class MottSchottkyExtractor {
+public:
+    using PointCallback = std::function<void(const MottSchottkyPoint&)>;
+
+    /**
+     * @param voltageStep the voltage step of the element in volts, used to tell potential steps apart.
+     * @param electrodeArea the electrode area in cm^2.
+     * @param relativePermittivity the dielectric constant of the semiconductor.
+     * @param temperature the temperature in Kelvin used for the kT/e correction.
+     */
+    MottSchottkyExtractor(double voltageStep, double electrodeArea, double relativePermittivity, double temperature = 298.15)
+        : m_stepTolerance(std::fabs(voltageStep) / 2)
+        , m_electrodeArea(electrodeArea)
+        , m_relativePermittivity(relativePermittivity)
+        , m_thermalVoltage(BoltzmannConstant * temperature / ElementaryCharge)
+    {
+    }
+
+    void setPointCallback(PointCallback callback) { m_callback = std::move(callback); }
+
+    void reset()
+    {
+        m_fits.clear();
+        m_potentialStep = -1;
+    }
+
+    void addPoint(const AisACData& data)
+    {
+        if (data.frequency <= 0 || data.imagImpedance >= 0)
+            return;
+
+        double potential = data.workingElectrodeDCVoltage;
+        if (m_potentialStep < 0 || std::fabs(potential - m_stepPotential) > m_stepTolerance) {
+            ++m_potentialStep;
+            m_stepPotential = potential;
+        }
+
+        double capacitance = -1.0 / (2 * Pi * data.frequency * data.imagImpedance);
+        double inverseSquare = 1.0 / (capacitance * capacitance);
+
+        FrequencyFit& fit = fitFor(data.frequency);
+        fit.n += 1;
+        fit.sumX += potential;
+        fit.sumY += inverseSquare;
+        fit.sumXX += potential * potential;
+        fit.sumXY += potential * inverseSquare;
+
+        MottSchottkyPoint point { m_potentialStep, potential, data.frequency, capacitance, inverseSquare, 0, 0, false };
+        double denominator = fit.n * fit.sumXX - fit.sumX * fit.sumX;
+        if (fit.n >= 2 && std::fabs(denominator) > 1e-12) {
+            // C^-2 is per unit area squared, so convert the slope from F^-2 V^-1 to (F/cm^2)^-2 V^-1
+            double slope = (fit.n * fit.sumXY - fit.sumX * fit.sumY) / denominator;
+            double intercept = (fit.sumY - slope * fit.sumX) / fit.n;
+            double arealSlope = slope * m_electrodeArea * m_electrodeArea;
+            point.flatBandPotential = -intercept / slope - m_thermalVoltage;
+            point.dopingDensity = 2.0 / (ElementaryCharge * m_relativePermittivity * VacuumPermittivity * std::fabs(arealSlope));
+            point.fitValid = true;
+        }
+
+        if (m_callback)
+            m_callback(point);
+    }
+
+private:
+    struct FrequencyFit {
+        double frequency;
+        double n = 0, sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+    };
+
+    FrequencyFit& fitFor(double frequency)
+    {
+        // every potential step repeats the same frequency list, so there are only a few fits to search
+        for (FrequencyFit& fit : m_fits) {
+            if (std::fabs(fit.frequency - frequency) <= 1e-3 * frequency)
+                return fit;
+        }
+        m_fits.push_back({ frequency });
+        return m_fits.back();
+    }
+
+    static constexpr double Pi = 3.14159265358979323846;
+    static constexpr double ElementaryCharge = 1.602176634e-19; // C
+    static constexpr double BoltzmannConstant = 1.380649e-23; // J/K
+    static constexpr double VacuumPermittivity = 8.8541878128e-14; // F/cm
+
+    double m_stepTolerance;
+    double m_electrodeArea;
+    double m_relativePermittivity;
+    double m_thermalVoltage;
+
+    int m_potentialStep = -1;
+    double m_stepPotential = 0;
+    std::vector<FrequencyFit> m_fits;
+    PointCallback m_callback;
+};
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // -1V to 1V in 50mV steps, 10kHz to 1kHz at 3 steps per decade, 10mV amplitude, 5 cycles minimum, 2s settling at each step
+    AisMottSchottkyElement msElement(-1, 1, 0.05, 10000, 1000, 3, 0.01, 5, 2);
+    msElement.setStartVoltageVsOCP(false);
+    msElement.setEndVoltageVsOCP(false);
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendElement(msElement, 1);
+
+    // 1cm^2 electrode of a semiconductor with a dielectric constant of 10
+    auto extractor = std::make_shared<MottSchottkyExtractor>(msElement.getVoltageStep(), 1.0, 10.0);
+    extractor->setPointCallback([](const MottSchottkyPoint& point) {
+        if (point.fitValid) {
+            qDebug() << "E:" << point.potential << "f:" << point.frequency << "C^-2:" << point.inverseSquareCapacitance
+                     << "Efb:" << point.flatBandPotential << "N:" << point.dopingDensity;
+        } else {
+            qDebug() << "E:" << point.potential << "f:" << point.frequency << "C^-2:" << point.inverseSquareCapacitance;
+        }
+    });
+
+    auto connectSignals = [=](const AisInstrumentHandler& handler) {
+        QObject::connect(&handler, &AisInstrumentHandler::activeACDataReady, [=](uint8_t channel, const AisACData& data) {
+            extractor->addPoint(data);
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString& reason) {
+            qDebug() << "Experiment Stopped Signal " << channel << "Reason : " << reason;
+            extractor->reset();
+        });
+    };
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        connectSignals(handler);
+
+        auto error = handler.uploadExperimentToChannel(CHANNEL, experiment);
+        if (error) {
+            qDebug() << error.message();
+            return;
+        }
+        error = handler.startUploadedExperiment(CHANNEL);
+        if (error) {
+            qDebug() << error.message();
+        }
+    });
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << "Error: " << error.message();
+        return 0;
+    }
+
+    return a.exec();
+}
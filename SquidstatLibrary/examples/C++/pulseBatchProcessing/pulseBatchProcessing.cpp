@@ -0,0 +1,162 @@
+/**
+ * \example pulseBatchProcessing.cpp
+ * This example shows how to reprocess archived pulse voltammetry data (DPV, NPV or SWV) in batches with `AisDataManipulator`.
+ *
+ * A whole block of samples is fed through the manipulator in one call, and the completed pulses are collected into
+ * contiguous arrays (structure of arrays) that are easy to hand to plotting or analysis code. This is a convenience, not
+ * a speed-up: the manipulator still takes every sample with AisDataManipulator::loadPrimaryData and is queried with its
+ * getters for every completed pulse, so the cost per sample inside the library stays the same. What does scale is the
+ * number of archives: they are independent of each other, so each one gets its own manipulator and they are processed
+ * in parallel.
+ *
+ * Usage: pulseBatchProcessing file1.csv [file2.csv ...]
+ * Each file is expected in the format written by the dataOutput example: "Time Stamp,Counter Electrode Voltage,Working Electrode Voltage,Current".
+ */
+#include "AisDataManipulator.h"
+
+#include "experiments/builder_elements/AisDiffPulseVoltammetryElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+#include <future>
+#include <vector>
+
+/**
+ * The pulse parameters of one block of samples, one entry per completed pulse.
+ */
+struct PulseBatchResult {
+    std::vector<double> timestamp;
+    std::vector<double> baseCurrent;
+    std::vector<double> pulseCurrent;
+    std::vector<double> differenceCurrent;
+    std::vector<double> baseVoltage;
+    std::vector<double> pulseVoltage;
+
+    size_t size() const { return timestamp.size(); }
+
+    void reserve(size_t count)
+    {
+        timestamp.reserve(count);
+        baseCurrent.reserve(count);
+        pulseCurrent.reserve(count);
+        differenceCurrent.reserve(count);
+        baseVoltage.reserve(count);
+        pulseVoltage.reserve(count);
+    }
+};
+
+/**
+ * @brief feeds a contiguous block of samples through the manipulator and collects every completed pulse.
+ * @param manipulator a manipulator constructed from the pulse element that produced the data.
+ * @param data pointer to the first sample of the block.
+ * @param count the number of samples in the block.
+ * @param result the arrays the completed pulses are appended to.
+ */
+static void processPulseBatch(AisDataManipulator& manipulator, const AisDCData* data, size_t count, PulseBatchResult& result)
+{
+    // a pulse needs at least a base and a pulse sample, so this bounds the number of results
+    result.reserve(result.size() + count / 2 + 1);
+
+    for (size_t i = 0; i < count; ++i) {
+        manipulator.loadPrimaryData(data[i]);
+        if (manipulator.isPulseCompleted()) {
+            double baseCurrent = manipulator.getBaseCurrent();
+            double pulseCurrent = manipulator.getPulseCurrent();
+            result.timestamp.push_back(data[i].timestamp);
+            result.baseCurrent.push_back(baseCurrent);
+            result.pulseCurrent.push_back(pulseCurrent);
+            result.differenceCurrent.push_back(pulseCurrent - baseCurrent);
+            result.baseVoltage.push_back(manipulator.getBaseVoltage());
+            result.pulseVoltage.push_back(manipulator.getPulseVoltage());
+        }
+    }
+}
+
+/**
+ * @brief processes a whole block of samples produced by the given pulse element.
+ */
+template <typename PulseElement>
+static PulseBatchResult processPulseBatch(const PulseElement& element, const std::vector<AisDCData>& data)
+{
+    AisDataManipulator manipulator(element);
+    PulseBatchResult result;
+    processPulseBatch(manipulator, data.data(), data.size(), result);
+    return result;
+}
+
+static std::vector<AisDCData> readArchive(const QString& filePath)
+{
+    std::vector<AisDCData> data;
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qDebug() << "Could not open" << filePath;
+        return data;
+    }
+
+    QTextStream in(&file);
+    in.readLine(); // header
+    while (!in.atEnd()) {
+        QStringList fields = in.readLine().split(',');
+        if (fields.size() < 4)
+            continue;
+        data.push_back({ fields[0].toDouble(), fields[2].toDouble(), fields[1].toDouble(), fields[3].toDouble(), 0.0 });
+    }
+    return data;
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList files = a.arguments().mid(1);
+    if (files.isEmpty()) {
+        qDebug() << "Usage: pulseBatchProcessing file1.csv [file2.csv ...]";
+        return 0;
+    }
+
+    // The element must match the one the archived data was recorded with, here the same DPV as in the pulseData example
+    AisDiffPulseVoltammetryElement dpvElement(-0.4, 0.5, 0.01, 0.1, 0.1, 0.45, 0.1);
+    dpvElement.setStartVoltageVsOCP(false);
+    dpvElement.setEndVoltageVsOCP(false);
+
+    std::vector<std::vector<AisDCData>> archives;
+    for (const QString& file : files)
+        archives.push_back(readArchive(file));
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // every archive gets its own manipulator, so they can be processed concurrently
+    std::vector<std::future<PulseBatchResult>> futures;
+    for (const auto& archive : archives) {
+        futures.push_back(std::async(std::launch::async, [&dpvElement, &archive]() {
+            return processPulseBatch(dpvElement, archive);
+        }));
+    }
+
+    size_t totalSamples = 0;
+    size_t totalPulses = 0;
+    for (size_t i = 0; i < futures.size(); ++i) {
+        PulseBatchResult result = futures[i].get();
+        totalSamples += archives[i].size();
+        totalPulses += result.size();
+
+        QFile file(files[i] + ".pulses.csv");
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+            continue;
+        QTextStream out(&file);
+        out << "time,pulse_current,base_current,diff_current,base_voltage,pulse_voltage\n";
+        for (size_t j = 0; j < result.size(); ++j) {
+            out << result.timestamp[j] << "," << result.pulseCurrent[j] << "," << result.baseCurrent[j] << ","
+                << result.differenceCurrent[j] << "," << result.baseVoltage[j] << "," << result.pulseVoltage[j] << "\n";
+        }
+    }
+
+    qDebug() << "Processed" << totalSamples << "samples into" << totalPulses << "pulses from" << files.size() << "archives in" << timer.elapsed() << "ms";
+    return 0;
+}
@@ -0,0 +1,142 @@
+/**
+ * \example pulseManipulatorBank.cpp
+ * This example shows how to run the same square wave voltammetry element on every channel of a device and compute the pulse
+ * parameters for all of them through a single bank of `AisDataManipulator` objects.
+ *
+ * The bank keeps one manipulator per channel in a contiguous array indexed by channel number, so a sample coming from
+ * AisInstrumentHandler::activeDCDataReady is routed with a single index instead of a lookup. Completed pulses are reported
+ * per channel through one callback.
+ */
+#include "AisDataManipulator.h"
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisSquareWaveVoltammetryElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+
+#include <functional>
+#include <vector>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+
+/**
+ * A completed pulse on one channel.
+ */
+struct PulseRecord {
+    uint8_t channel;
+    double timestamp;
+    double baseCurrent;
+    double pulseCurrent;
+    double baseVoltage;
+    double pulseVoltage;
+};
+
+/**
+ * Holds the pulse state for a number of channels that all run the same pulse element.
+ */
+class PulseManipulatorBank {
+public:
+    using PulseCallback = std::function<void(const PulseRecord&)>;
+
+    /**
+     * @param element the pulse element every channel runs.
+     * @param numberOfChannels the number of channels of the device.
+     */
+    template <typename PulseElement>
+    PulseManipulatorBank(const PulseElement& element, int numberOfChannels)
+    {
+        // AisDataManipulator shares its state between copies, so every channel needs its own constructed instance
+        m_manipulators.reserve(numberOfChannels);
+        for (int i = 0; i < numberOfChannels; ++i)
+            m_manipulators.emplace_back(element);
+        m_pulseCounts.assign(numberOfChannels, 0);
+    }
+
+    void setPulseCallback(PulseCallback callback) { m_callback = std::move(callback); }
+
+    /**
+     * @brief routes a sample to the manipulator of its channel and reports the pulse if one completed.
+     */
+    void loadPrimaryData(uint8_t channel, const AisDCData& data)
+    {
+        if (channel >= m_manipulators.size())
+            return;
+
+        AisDataManipulator& manipulator = m_manipulators[channel];
+        manipulator.loadPrimaryData(data);
+        if (!manipulator.isPulseCompleted())
+            return;
+
+        ++m_pulseCounts[channel];
+        if (m_callback) {
+            m_callback({ channel, data.timestamp, manipulator.getBaseCurrent(), manipulator.getPulseCurrent(),
+                manipulator.getBaseVoltage(), manipulator.getPulseVoltage() });
+        }
+    }
+
+    /**
+     * @brief get the number of pulses completed on a channel.
+     */
+    size_t pulseCount(uint8_t channel) const { return channel < m_pulseCounts.size() ? m_pulseCounts[channel] : 0; }
+
+private:
+    std::vector<AisDataManipulator> m_manipulators;
+    std::vector<size_t> m_pulseCounts;
+    PulseCallback m_callback;
+};
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // A fast square wave voltammetry: -0.5V to 0.5V in 5mV steps, 25mV amplitude at 100Hz, up to 1mA expected
+    AisSquareWaveVoltammetryElement swvElement(-0.5, 0.5, 0.005, 0.025, 100, 0.001);
+    swvElement.setStartVoltageVsOCP(false);
+    swvElement.setEndVoltageVsOCP(false);
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendElement(swvElement, 1);
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        int numberOfChannels = handler.getNumberOfChannels();
+
+        auto bank = std::make_shared<PulseManipulatorBank>(swvElement, numberOfChannels);
+        bank->setPulseCallback([](const PulseRecord& pulse) {
+            qDebug() << "channel: " << pulse.channel << " time: " << pulse.timestamp << " diff current: " << pulse.pulseCurrent - pulse.baseCurrent
+                     << " base voltage: " << pulse.baseVoltage << " pulse voltage: " << pulse.pulseVoltage;
+        });
+
+        // the bank is fed straight from the handler signal, the channel number selects the pulse state
+        QObject::connect(&handler, &AisInstrumentHandler::activeDCDataReady, [bank](uint8_t channel, const AisDCData& data) {
+            bank->loadPrimaryData(channel, data);
+        });
+
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [bank](uint8_t channel, const QString& reason) {
+            qDebug() << "Experiment Stopped Signal " << channel << "Reason : " << reason << " pulses: " << bank->pulseCount(channel);
+        });
+
+        for (int channel = 0; channel < numberOfChannels; ++channel) {
+            auto error = handler.uploadExperimentToChannel(channel, experiment);
+            if (!error)
+                error = handler.startUploadedExperiment(channel);
+            if (error)
+                qDebug() << "Channel" << channel << ":" << error.message();
+        }
+    });
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << "Error: " << error.message();
+        return 0;
+    }
+
+    return a.exec();
+}
@@ -0,0 +1,383 @@
+/**
+ * \example relaxationTimes.cpp
+ * This example shows how to compute the distribution of relaxation times (DRT) of EIS spectra, both for a spectrum
+ * that has just been measured and for a whole archive of spectra at once.
+ *
+ * The impedance is modelled as Z(&omega;) = R<sub>&infin;</sub> + &Sigma; &gamma;<sub>k</sub> / (1 + j&omega;&tau;<sub>k</sub>)
+ * on a logarithmic grid of time constants &tau;<sub>k</sub>. The amplitudes are found with a Tikhonov regularized
+ * non-negative least squares fit of the real and imaginary parts together, weighted by the impedance modulus. The
+ * regularization penalizes the difference between neighbouring amplitudes. The problem is small (one unknown per grid
+ * point), so it is solved on its normal equations with the Lawson-Hanson active set method, which keeps every amplitude
+ * non-negative. The batch mode distributes the spectra of an archive over all cores.
+ *
+ * Run the example with "--benchmark" to process a batch of synthetic spectra without an instrument attached. It reports
+ * the mean and the worst error of R<sub>&infin;</sub> and of the total polarization over the batch.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisEISGalvanostaticElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+#define CHANNEL 0
+
+static constexpr double Pi = 3.14159265358979323846;
+
+/**
+ * The distribution of relaxation times of one spectrum.
+ */
+struct RelaxationTimeDistribution {
+    double highFrequencyResistance = 0; ///< R_inf in ohms.
+    std::vector<double> tau; ///< the time constants in seconds.
+    std::vector<double> gamma; ///< the polarization resistance at every time constant in ohms.
+    std::vector<double> distribution; ///< gamma divided by the grid spacing in ln(tau), in ohms.
+    double residual = 0; ///< the root mean square of the modulus weighted residuals.
+    int iterations = 0; ///< the number of active set changes the solver needed.
+};
+
+/**
+ * Computes the DRT of spectra on a fixed grid of time constants.
+ */
+class RelaxationTimeSolver {
+public:
+    /**
+     * @param minTau the smallest time constant of the grid in seconds.
+     * @param maxTau the largest time constant of the grid in seconds.
+     * @param pointsPerDecade the number of grid points per decade of time constant.
+     * @param regularization the weight of the smoothness penalty.
+     */
+    RelaxationTimeSolver(double minTau, double maxTau, int pointsPerDecade = 10, double regularization = 1e-3)
+        : m_regularization(regularization)
+    {
+        int count = std::max(2, static_cast<int>(std::ceil(std::log10(maxTau / minTau) * pointsPerDecade)) + 1);
+        m_logSpacing = std::log(maxTau / minTau) / (count - 1);
+        for (int k = 0; k < count; ++k)
+            m_tau.push_back(minTau * std::exp(k * m_logSpacing));
+    }
+
+    /**
+     * @brief a solver whose grid extends one decade beyond the frequency range of the spectra on each side.
+     */
+    static RelaxationTimeSolver forFrequencyRange(double startFrequency, double endFrequency, int pointsPerDecade = 10, double regularization = 1e-3)
+    {
+        double minFrequency = std::min(startFrequency, endFrequency);
+        double maxFrequency = std::max(startFrequency, endFrequency);
+        return RelaxationTimeSolver(0.1 / (2 * Pi * maxFrequency), 10 / (2 * Pi * minFrequency), pointsPerDecade, regularization);
+    }
+
+    RelaxationTimeDistribution solve(const std::vector<AisACData>& spectrum) const
+    {
+        const size_t K = m_tau.size();
+        const size_t n = K + 1; // R_inf followed by the amplitudes
+
+        // normal equations H x = b of the weighted least squares problem
+        std::vector<double> H(n * n, 0.0), b(n, 0.0), row(n);
+        std::vector<double> magnitudes;
+        for (const AisACData& point : spectrum) {
+            double omega = 2 * Pi * point.frequency;
+            double magnitude = std::max(std::hypot(point.realImpedance, point.imagImpedance), 1e-12);
+            double weight = 1.0 / magnitude;
+            magnitudes.push_back(magnitude);
+
+            for (int part = 0; part < 2; ++part) {
+                row[0] = part == 0 ? weight : 0;
+                for (size_t k = 0; k < K; ++k) {
+                    double wt = omega * m_tau[k];
+                    row[k + 1] = weight * (part == 0 ? 1 : -wt) / (1 + wt * wt);
+                }
+                double y = weight * (part == 0 ? point.realImpedance : point.imagImpedance);
+                for (size_t i = 0; i < n; ++i) {
+                    b[i] += row[i] * y;
+                    double* h = &H[i * n];
+                    for (size_t j = i; j < n; ++j)
+                        h[j] += row[i] * row[j];
+                }
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < i; ++j)
+                H[i * n + j] = H[j * n + i];
+        }
+
+        // smoothness penalty on neighbouring amplitudes, scaled by the typical impedance so it is unit free
+        std::nth_element(magnitudes.begin(), magnitudes.begin() + magnitudes.size() / 2, magnitudes.end());
+        double scale = magnitudes[magnitudes.size() / 2];
+        double penalty = m_regularization / (scale * scale);
+        for (size_t k = 1; k + 1 < n; ++k) {
+            H[k * n + k] += penalty;
+            H[(k + 1) * n + (k + 1)] += penalty;
+            H[k * n + (k + 1)] -= penalty;
+            H[(k + 1) * n + k] -= penalty;
+        }
+
+        RelaxationTimeDistribution result;
+        std::vector<double> x = nonNegativeLeastSquares(H, b, n, result.iterations);
+
+        double sumOfSquares = 0;
+        for (const AisACData& point : spectrum) {
+            double omega = 2 * Pi * point.frequency;
+            std::complex<double> model = x[0];
+            for (size_t k = 0; k < K; ++k)
+                model += x[k + 1] / std::complex<double>(1, omega * m_tau[k]);
+            std::complex<double> measured(point.realImpedance, point.imagImpedance);
+            sumOfSquares += std::norm((model - measured) / std::abs(measured));
+        }
+
+        result.highFrequencyResistance = x[0];
+        result.tau = m_tau;
+        result.gamma.assign(x.begin() + 1, x.end());
+        result.distribution.resize(K);
+        for (size_t k = 0; k < K; ++k)
+            result.distribution[k] = result.gamma[k] / m_logSpacing;
+        result.residual = std::sqrt(sumOfSquares / (2 * spectrum.size()));
+        return result;
+    }
+
+    /**
+     * @brief computes the DRT of every spectrum of an archive, spread over the given number of threads.
+     */
+    std::vector<RelaxationTimeDistribution> solve(const std::vector<std::vector<AisACData>>& spectra,
+        unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency())) const
+    {
+        std::vector<RelaxationTimeDistribution> results(spectra.size());
+        std::atomic<size_t> next(0);
+        auto worker = [&]() {
+            for (size_t i = next++; i < spectra.size(); i = next++) {
+                if (!spectra[i].empty())
+                    results[i] = solve(spectra[i]);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned int t = 1; t < threadCount; ++t)
+            threads.emplace_back(worker);
+        worker();
+        for (std::thread& thread : threads)
+            thread.join();
+        return results;
+    }
+
+private:
+    /*
+     * Lawson-Hanson active set method for min 1/2 x'Hx - b'x subject to x >= 0, with H symmetric positive definite.
+     * Variables enter the passive set one at a time; the unconstrained problem on the passive set is solved with a
+     * Cholesky factorization and variables that would turn negative are moved back out.
+     */
+    static std::vector<double> nonNegativeLeastSquares(const std::vector<double>& H, const std::vector<double>& b, size_t n, int& iterations)
+    {
+        std::vector<double> x(n, 0.0), s(n, 0.0), w(b);
+        std::vector<char> passive(n, 0);
+        double tolerance = 1e-12 * std::max(1.0, *std::max_element(b.begin(), b.end()));
+
+        for (iterations = 0; iterations < 3 * static_cast<int>(n); ++iterations) {
+            size_t entering = n;
+            double largest = tolerance;
+            for (size_t i = 0; i < n; ++i) {
+                if (!passive[i] && w[i] > largest) {
+                    largest = w[i];
+                    entering = i;
+                }
+            }
+            if (entering == n)
+                break;
+            passive[entering] = 1;
+
+            for (;;) {
+                solvePassive(H, b, n, passive, s);
+                double alpha = 1;
+                bool feasible = true;
+                for (size_t i = 0; i < n; ++i) {
+                    if (passive[i] && s[i] <= 0) {
+                        feasible = false;
+                        alpha = std::min(alpha, x[i] / (x[i] - s[i]));
+                    }
+                }
+                if (feasible) {
+                    x = s;
+                    break;
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    x[i] += alpha * (s[i] - x[i]);
+                    if (passive[i] && x[i] <= 1e-15) {
+                        passive[i] = 0;
+                        x[i] = 0;
+                    }
+                }
+            }
+
+            for (size_t i = 0; i < n; ++i) {
+                double hx = 0;
+                for (size_t j = 0; j < n; ++j)
+                    hx += H[i * n + j] * x[j];
+                w[i] = b[i] - hx;
+            }
+        }
+        return x;
+    }
+
+    // solves H_PP s_P = b_P on the passive set P and sets the other entries of s to zero
+    static void solvePassive(const std::vector<double>& H, const std::vector<double>& b, size_t n, const std::vector<char>& passive, std::vector<double>& s)
+    {
+        std::vector<size_t> index;
+        for (size_t i = 0; i < n; ++i) {
+            if (passive[i])
+                index.push_back(i);
+        }
+        const size_t m = index.size();
+        std::vector<double> L(m * m, 0.0), y(m);
+        for (size_t r = 0; r < m; ++r) {
+            for (size_t c = 0; c <= r; ++c) {
+                double sum = H[index[r] * n + index[c]];
+                for (size_t k = 0; k < c; ++k)
+                    sum -= L[r * m + k] * L[c * m + k];
+                L[r * m + c] = r == c ? std::sqrt(std::max(sum, 1e-300)) : sum / L[c * m + c];
+            }
+        }
+        for (size_t r = 0; r < m; ++r) {
+            double sum = b[index[r]];
+            for (size_t k = 0; k < r; ++k)
+                sum -= L[r * m + k] * y[k];
+            y[r] = sum / L[r * m + r];
+        }
+        for (size_t r = m; r-- > 0;) {
+            double sum = y[r];
+            for (size_t k = r + 1; k < m; ++k)
+                sum -= L[k * m + r] * y[k];
+            y[r] = sum / L[r * m + r];
+        }
+        std::fill(s.begin(), s.end(), 0.0);
+        for (size_t r = 0; r < m; ++r)
+            s[index[r]] = y[r];
+    }
+
+    std::vector<double> m_tau;
+    double m_logSpacing;
+    double m_regularization;
+};
+
+// Computes the DRT of a batch of synthetic two-arc spectra and reports throughput
+static void runBenchmark()
+{
+    const int numberOfSpectra = 2000;
+    std::mt19937 generator(3);
+    std::normal_distribution<double> noise(0, 0.002);
+
+    std::vector<std::vector<AisACData>> spectra(numberOfSpectra);
+    for (auto& spectrum : spectra) {
+        for (double logFrequency = 5; logFrequency >= -1; logFrequency -= 0.1) {
+            double frequency = std::pow(10.0, logFrequency);
+            double omega = 2 * Pi * frequency;
+            // two RC arcs with time constants of 10us and 10ms
+            std::complex<double> z = 0.05 + 0.02 / std::complex<double>(1, omega * 1e-5) + 0.03 / std::complex<double>(1, omega * 1e-2);
+            z *= std::complex<double>(1 + noise(generator), noise(generator));
+            AisACData point {};
+            point.frequency = frequency;
+            point.realImpedance = z.real();
+            point.imagImpedance = z.imag();
+            spectrum.push_back(point);
+        }
+    }
+
+    RelaxationTimeSolver solver = RelaxationTimeSolver::forFrequencyRange(100000, 0.1);
+    unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<RelaxationTimeDistribution> single = solver.solve(spectra, 1);
+    qint64 singleElapsed = timer.restart();
+    std::vector<RelaxationTimeDistribution> parallel = solver.solve(spectra, threadCount);
+    qint64 parallelElapsed = timer.elapsed();
+
+    // every spectrum has R_inf = 0.05 and a total polarization of 0.05, up to the noise
+    double worstResistanceError = 0, worstPolarizationError = 0, meanResistanceError = 0, meanPolarizationError = 0;
+    for (const RelaxationTimeDistribution& drt : parallel) {
+        double polarization = 0;
+        for (double gamma : drt.gamma)
+            polarization += gamma;
+        double resistanceError = std::fabs(drt.highFrequencyResistance / 0.05 - 1);
+        double polarizationError = std::fabs(polarization / 0.05 - 1);
+        worstResistanceError = std::max(worstResistanceError, resistanceError);
+        worstPolarizationError = std::max(worstPolarizationError, polarizationError);
+        meanResistanceError += resistanceError / parallel.size();
+        meanPolarizationError += polarizationError / parallel.size();
+    }
+    qDebug() << "DRT of" << numberOfSpectra << "spectra on" << parallel.front().tau.size() << "time constants:" << singleElapsed << "ms on 1 thread,"
+             << parallelElapsed << "ms on" << threadCount << "threads.";
+    qDebug() << "Error of R_inf: mean" << meanResistanceError * 100 << "% worst" << worstResistanceError * 100 << "%, of the total polarization: mean"
+             << meanPolarizationError * 100 << "% worst" << worstPolarizationError * 100 << "%";
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    if (a.arguments().contains("--benchmark")) {
+        runBenchmark();
+        return 0;
+    }
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // 10kHz to 0.1Hz, 10 steps per decade, no bias current with 10mA amplitude
+    AisEISGalvanostaticElement eisElement(10000, 0.1, 10, 0, 0.01);
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendElement(eisElement, 1);
+
+    const double endFrequency = eisElement.getEndFreq();
+    auto solver = std::make_shared<RelaxationTimeSolver>(RelaxationTimeSolver::forFrequencyRange(eisElement.getStartFreq(), endFrequency));
+    auto spectrum = std::make_shared<std::vector<AisACData>>();
+
+    auto connectSignals = [=](const AisInstrumentHandler& handler) {
+        QObject::connect(&handler, &AisInstrumentHandler::activeACDataReady, [=](uint8_t channel, const AisACData& data) {
+            spectrum->push_back(data);
+            if (std::fabs(data.frequency - endFrequency) > 1e-3 * endFrequency)
+                return;
+
+            RelaxationTimeDistribution drt = solver->solve(*spectrum);
+            spectrum->clear();
+            qDebug() << "R_inf:" << drt.highFrequencyResistance << "residual:" << drt.residual;
+            for (size_t k = 0; k < drt.tau.size(); ++k)
+                qDebug() << "tau:" << drt.tau[k] << "g(tau):" << drt.distribution[k];
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString& reason) {
+            qDebug() << "Experiment Stopped Signal " << channel << "Reason : " << reason;
+        });
+    };
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        connectSignals(handler);
+
+        auto error = handler.uploadExperimentToChannel(CHANNEL, experiment);
+        if (error) {
+            qDebug() << error.message();
+            return;
+        }
+        error = handler.startUploadedExperiment(CHANNEL);
+        if (error) {
+            qDebug() << error.message();
+        }
+    });
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << "Error: " << error.message();
+        return 0;
+    }
+
+    return a.exec();
+}
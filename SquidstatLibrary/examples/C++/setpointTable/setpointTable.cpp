@@ -0,0 +1,262 @@
+/**
+ * \example setpointTable.cpp
+ * This example shows how to play back a table of (time, setpoint, mode) points on the instrument timebase, instead of
+ * sending AisInstrumentHandler::setManualModeConstantVoltage or AisInstrumentHandler::setManualModeConstantCurrent
+ * from a timed loop on the host.
+ *
+ * The table is compiled into a regular `AisExperiment` and uploaded with a single call:
+ * - consecutive points that hold the same setpoint, or that lie on the same ramp, are merged into one element:
+ *   a constant potential or current element for a hold, a DC potential or current sweep for a ramp.
+ * - if the resulting list of elements is a repetition of a shorter pattern, the pattern is appended once as a sub
+ *   experiment with a repeat count.
+ *
+ * A table of many thousands of points of a periodic waveform therefore uploads as a handful of elements.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantCurrentElement.h"
+#include "experiments/builder_elements/AisConstantPotElement.h"
+#include "experiments/builder_elements/AisDCCurrentSweepElement.h"
+#include "experiments/builder_elements/AisDCPotentialSweepElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+#define CHANNEL 0
+
+enum class SetpointMode {
+    Potential, ///< the setpoint is a potential in volts.
+    Current ///< the setpoint is a current in Amps.
+};
+
+/**
+ * A part of the waveform that one element can play: a hold when start and end are equal, otherwise a linear ramp.
+ */
+struct WaveformSegment {
+    SetpointMode mode;
+    double start;
+    double end;
+    double duration; ///< in seconds.
+};
+
+/**
+ * A table of setpoints that compiles into an experiment.
+ */
+class SetpointTable {
+public:
+    enum class Interpolation {
+        Hold, ///< every setpoint is held until the time of the next point.
+        Linear ///< the setpoint ramps linearly to the next point if both points have the same mode, and is held otherwise.
+    };
+
+    /**
+     * @param interpolation how the setpoint moves between points.
+     * @param tolerance the largest difference between two setpoints, in volts or Amps, that is still considered equal.
+     */
+    explicit SetpointTable(Interpolation interpolation = Interpolation::Hold, double tolerance = 1e-6)
+        : m_interpolation(interpolation)
+        , m_tolerance(tolerance)
+    {
+    }
+
+    /**
+     * @brief appends a point to the table. The setpoint of the last point only ends the waveform, it is not held.
+     * @param time the time of the point in seconds since the start of the waveform.
+     * @return false if the time is not after the time of the previous point.
+     */
+    bool append(double time, double setpoint, SetpointMode mode)
+    {
+        if (!m_points.empty() && time <= m_points.back().time)
+            return false;
+        m_points.push_back({ time, setpoint, mode });
+        return true;
+    }
+
+    size_t size() const { return m_points.size(); }
+
+    /**
+     * @brief the table as a list of segments, with every hold and every ramp merged as far as possible.
+     */
+    std::vector<WaveformSegment> segments() const
+    {
+        std::vector<WaveformSegment> result;
+        for (size_t i = 0; i + 1 < m_points.size(); ++i) {
+            const Point& point = m_points[i];
+            const Point& next = m_points[i + 1];
+            bool ramp = m_interpolation == Interpolation::Linear && point.mode == next.mode;
+            WaveformSegment segment { point.mode, point.setpoint, ramp ? next.setpoint : point.setpoint, next.time - point.time };
+
+            if (!result.empty() && continues(result.back(), segment)) {
+                result.back().end = segment.end;
+                result.back().duration += segment.duration;
+            } else {
+                result.push_back(segment);
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief compiles the table into an experiment.
+     * @param samplingInterval the data sampling interval in seconds.
+     * @param elementCount if not null, receives the number of elements the experiment holds.
+     * @return the experiment, or nullptr if the table has fewer than two points or an element could not be appended.
+     */
+    std::shared_ptr<AisExperiment> toExperiment(double samplingInterval, size_t* elementCount = nullptr) const
+    {
+        std::vector<WaveformSegment> all = segments();
+        if (all.empty())
+            return nullptr;
+
+        size_t period = findPeriod(all);
+        size_t repeat = all.size() / period;
+        if (elementCount)
+            *elementCount = period;
+
+        AisExperiment pattern;
+        bool success = true;
+        for (size_t i = 0; i < period; ++i)
+            success &= appendSegment(pattern, all[i], samplingInterval);
+
+        auto experiment = std::make_shared<AisExperiment>();
+        // a sub experiment repeats at most 65535 times, so longer repetitions are split
+        for (size_t remaining = repeat; remaining > 0;) {
+            unsigned int count = static_cast<unsigned int>(std::min<size_t>(remaining, 65535));
+            success &= experiment->appendSubExperiment(pattern, count);
+            remaining -= count;
+        }
+        return success ? experiment : nullptr;
+    }
+
+private:
+    struct Point {
+        double time;
+        double setpoint;
+        SetpointMode mode;
+    };
+
+    // true if the second segment carries on the first one at the same rate
+    bool continues(const WaveformSegment& first, const WaveformSegment& second) const
+    {
+        if (first.mode != second.mode || std::fabs(first.end - second.start) > m_tolerance)
+            return false;
+        double firstRate = (first.end - first.start) / first.duration;
+        double secondRate = (second.end - second.start) / second.duration;
+        return std::fabs(firstRate - secondRate) * (first.duration + second.duration) <= m_tolerance;
+    }
+
+    bool equal(const WaveformSegment& a, const WaveformSegment& b) const
+    {
+        return a.mode == b.mode && std::fabs(a.start - b.start) <= m_tolerance && std::fabs(a.end - b.end) <= m_tolerance
+            && std::fabs(a.duration - b.duration) <= 1e-9 * std::max(a.duration, b.duration);
+    }
+
+    // the length of the shortest pattern that the segments are a whole number of repetitions of
+    size_t findPeriod(const std::vector<WaveformSegment>& all) const
+    {
+        const size_t n = all.size();
+        for (size_t period = 1; period < n; ++period) {
+            if (n % period != 0)
+                continue;
+            bool repeats = true;
+            for (size_t i = period; i < n && repeats; ++i)
+                repeats = equal(all[i], all[i - period]);
+            if (repeats)
+                return period;
+        }
+        return n;
+    }
+
+    static bool appendSegment(AisExperiment& experiment, const WaveformSegment& segment, double samplingInterval)
+    {
+        double interval = std::min(samplingInterval, segment.duration);
+        if (segment.start == segment.end) {
+            if (segment.mode == SetpointMode::Potential) {
+                AisConstantPotElement element(segment.start, interval, segment.duration);
+                element.setVoltageVsOCP(false);
+                return experiment.appendElement(element, 1);
+            }
+            AisConstantCurrentElement element(segment.start, interval, segment.duration);
+            return experiment.appendElement(element, 1);
+        }
+
+        double scanRate = std::fabs(segment.end - segment.start) / segment.duration;
+        if (segment.mode == SetpointMode::Potential) {
+            AisDCPotentialSweepElement element(segment.start, segment.end, scanRate, interval);
+            element.setStartVoltageVsOCP(false);
+            element.setEndVoltageVsOCP(false);
+            return experiment.appendElement(element, 1);
+        }
+        AisDCCurrentSweepElement element(segment.start, segment.end, scanRate, interval);
+        return experiment.appendElement(element, 1);
+    }
+
+    Interpolation m_interpolation;
+    double m_tolerance;
+    std::vector<Point> m_points;
+};
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // a triangle wave between 0V and 0.5V with a 2s period, given as 10ms points over 100 periods
+    SetpointTable table(SetpointTable::Interpolation::Linear);
+    const double step = 0.01;
+    for (int i = 0; i <= 20000; ++i) {
+        double phase = std::fmod(i * step, 2.0);
+        table.append(i * step, phase < 1 ? 0.5 * phase : 0.5 * (2 - phase), SetpointMode::Potential);
+    }
+
+    size_t elementCount = 0;
+    std::shared_ptr<AisExperiment> experiment = table.toExperiment(0.01, &elementCount);
+    if (!experiment) {
+        qDebug() << "The setpoint table could not be compiled";
+        return 0;
+    }
+    qDebug() << table.size() << "setpoints compiled into" << elementCount << "elements";
+
+    auto connectSignals = [=](const AisInstrumentHandler& handler) {
+        QObject::connect(&handler, &AisInstrumentHandler::activeDCDataReady, [=](uint8_t channel, const AisDCData& data) {
+            qDebug() << "Timestamp: " << data.timestamp << " Current: " << data.current << " Voltage: " << data.workingElectrodeVoltage;
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString& reason) {
+            qDebug() << "Experiment Stopped Signal " << channel << "Reason : " << reason;
+        });
+    };
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        connectSignals(handler);
+
+        auto error = handler.uploadExperimentToChannel(CHANNEL, experiment);
+        if (error) {
+            qDebug() << error.message();
+            return;
+        }
+        error = handler.startUploadedExperiment(CHANNEL);
+        if (error) {
+            qDebug() << error.message();
+        }
+    });
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << "Error: " << error.message();
+        return 0;
+    }
+
+    return a.exec();
+}
@@ -0,0 +1,259 @@
+/**
+ * \example tickTimestamps.cpp
+ * This example shows how to give every sample an integer timestamp, so that samples of several channels can be sorted,
+ * joined and resampled with exact integer comparisons instead of comparisons of doubles within an epsilon.
+ *
+ * `AisDCData::timestamp` is in seconds since the start of the experiment on its channel. To compare channels, it has to
+ * be added to AisInstrumentHandler::getExperimentUTCStartTime, and a double that holds the seconds since 1970 only
+ * resolves about a quarter of a microsecond. `TickTimestamper` instead converts the start time and the timestamp to
+ * ticks separately and adds the integers, so the time between any two samples keeps the full resolution of the ticks.
+ *
+ * Samples taken at a fixed interval lie on a grid. The timestamper learns the interval of each element from its first
+ * samples and snaps the ticks of the following samples onto that grid when they are within one tick of it, so the
+ * rounding of the doubles does not make the intervals jitter by a tick.
+ *
+ * The example runs the same experiment on two channels, pairs every sample of channel 1 with the latest sample of
+ * channel 0 at or before it, and averages both channels over exact 100ms buckets.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantPotElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+
+#include <cmath>
+#include <deque>
+#include <map>
+
+// Define relevant device information, for easy access
+#define COMPORT "COM1"
+
+/**
+ * A DC sample with an integer timestamp in ticks since the Unix Epoch.
+ */
+struct TickedDCData {
+    int64_t ticks;
+    int64_t tickFrequency; ///< ticks per second.
+    AisDCData data;
+};
+
+/**
+ * Gives the samples of every channel of a handler integer timestamps on a common time base.
+ */
+class TickTimestamper {
+public:
+    /**
+     * @param tickFrequency the ticks per second; a microsecond resolution by default.
+     */
+    explicit TickTimestamper(const AisInstrumentHandler& handler, int64_t tickFrequency = 1000000)
+        : m_handler(handler)
+        , m_frequency(tickFrequency)
+    {
+    }
+
+    int64_t tickFrequency() const { return m_frequency; }
+
+    int64_t toTicks(double seconds) const { return std::llround(seconds * m_frequency); }
+
+    /**
+     * @brief forgets the start time of the experiment on the channel. Call this when an experiment stops.
+     */
+    void experimentStopped(uint8_t channel) { m_channels.erase(channel); }
+
+    /**
+     * @brief starts a new sampling grid. Call this when a new element starts, since its interval may differ.
+     */
+    void elementStarting(uint8_t channel)
+    {
+        auto found = m_channels.find(channel);
+        if (found != m_channels.end())
+            found->second.grid = Grid();
+    }
+
+    TickedDCData stamp(uint8_t channel, const AisDCData& data)
+    {
+        auto found = m_channels.find(channel);
+        if (found == m_channels.end()) {
+            Channel state;
+            state.startTicks = toTicks(m_handler.getExperimentUTCStartTime(channel));
+            found = m_channels.emplace(channel, state).first;
+        }
+        Channel& state = found->second;
+        return { state.startTicks + snap(state.grid, toTicks(data.timestamp)), m_frequency, data };
+    }
+
+private:
+    struct Grid {
+        int64_t anchor = -1; ///< the ticks of the first sample of the grid, -1 before the first sample.
+        int64_t count = 0; ///< the samples since the anchor.
+    };
+
+    struct Channel {
+        int64_t startTicks = 0;
+        Grid grid;
+    };
+
+    // moves the ticks onto the grid of the element if they are within one tick of it, and starts a new grid otherwise
+    static int64_t snap(Grid& grid, int64_t ticks)
+    {
+        if (grid.anchor >= 0) {
+            ++grid.count;
+            // the interval is estimated over all samples since the anchor, so it is exact after a few samples
+            int64_t interval = std::llround(static_cast<double>(ticks - grid.anchor) / grid.count);
+            int64_t expected = grid.anchor + grid.count * interval;
+            if (interval > 0 && std::llabs(ticks - expected) <= 1)
+                return expected;
+        }
+        // the first sample of an element, a lost sample or a changed interval starts the grid again here
+        grid.anchor = ticks;
+        grid.count = 0;
+        return ticks;
+    }
+
+    const AisInstrumentHandler& m_handler;
+    int64_t m_frequency;
+    std::map<uint8_t, Channel> m_channels;
+};
+
+/**
+ * Pairs every sample of one channel with the latest sample of a reference channel at or before it.
+ */
+class AsOfJoin {
+public:
+    void addReference(const TickedDCData& sample) { m_reference.push_back(sample); }
+
+    /**
+     * @brief finds the reference sample for a sample of the other channel.
+     * @return false if no reference sample is at or before the sample yet.
+     * @note the samples of each channel have to arrive in time order, which they do from the handler.
+     */
+    bool join(const TickedDCData& sample, TickedDCData& reference)
+    {
+        // the reference samples before the latest one at or before the sample are not needed anymore
+        while (m_reference.size() > 1 && m_reference[1].ticks <= sample.ticks)
+            m_reference.pop_front();
+        if (m_reference.empty() || m_reference.front().ticks > sample.ticks)
+            return false;
+        reference = m_reference.front();
+        return true;
+    }
+
+private:
+    std::deque<TickedDCData> m_reference;
+};
+
+/**
+ * Averages the current of a channel over buckets of a fixed number of ticks.
+ */
+class BucketAverage {
+public:
+    explicit BucketAverage(int64_t bucketTicks)
+        : m_bucketTicks(bucketTicks)
+    {
+    }
+
+    /**
+     * @brief adds a sample; when it is the first one of a new bucket, the previous bucket is complete.
+     * @return true if a bucket was completed, with its start and average current.
+     */
+    bool add(const TickedDCData& sample, int64_t& bucketStart, double& averageCurrent)
+    {
+        // the start of the bucket rounds down, also for ticks before the Epoch
+        int64_t bucket = sample.ticks / m_bucketTicks - (sample.ticks % m_bucketTicks < 0 ? 1 : 0);
+        bool completed = m_count > 0 && bucket != m_bucket;
+        if (completed) {
+            bucketStart = m_bucket * m_bucketTicks;
+            averageCurrent = m_sum / m_count;
+            m_sum = 0;
+            m_count = 0;
+        }
+        m_bucket = bucket;
+        m_sum += sample.data.current;
+        ++m_count;
+        return completed;
+    }
+
+private:
+    int64_t m_bucketTicks;
+    int64_t m_bucket = 0;
+    double m_sum = 0;
+    int m_count = 0;
+};
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // hold 0.1V for 30 seconds, sampled every 10ms
+    AisConstantPotElement cvElement(0.1, 0.01, 30);
+    auto experiment = std::make_shared<AisExperiment>();
+    experiment->appendElement(cvElement, 1);
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        if (handler.getNumberOfChannels() < 2) {
+            qDebug() << deviceName << "needs two channels for this example";
+            return;
+        }
+
+        auto timestamper = std::make_shared<TickTimestamper>(handler);
+        auto join = std::make_shared<AsOfJoin>();
+        const int64_t bucketTicks = timestamper->tickFrequency() / 10;
+        auto averages = std::make_shared<std::map<uint8_t, BucketAverage>>();
+        averages->emplace(0, BucketAverage(bucketTicks));
+        averages->emplace(1, BucketAverage(bucketTicks));
+        auto running = std::make_shared<int>(0);
+
+        QObject::connect(&handler, &AisInstrumentHandler::activeDCDataReady, [=](uint8_t channel, const AisDCData& data) {
+            if (channel > 1)
+                return;
+            TickedDCData sample = timestamper->stamp(channel, data);
+
+            TickedDCData reference;
+            if (channel == 0)
+                join->addReference(sample);
+            else if (join->join(sample, reference))
+                qDebug() << "Channel 1 at" << sample.ticks << "joins channel 0 at" << reference.ticks << ": current difference" << sample.data.current - reference.data.current;
+
+            int64_t bucketStart;
+            double averageCurrent;
+            if (averages->at(channel).add(sample, bucketStart, averageCurrent))
+                qDebug() << "Channel" << channel << "average current from" << bucketStart << ":" << averageCurrent;
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentNewElementStarting, [=](uint8_t channel, const AisExperimentNode&) {
+            timestamper->elementStarting(channel);
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [=](uint8_t channel, const QString& reason) {
+            qDebug() << "Experiment Stopped Signal " << channel << "Reason : " << reason;
+            timestamper->experimentStopped(channel);
+            if (--*running == 0)
+                QCoreApplication::quit();
+        });
+
+        for (uint8_t channel : { 0, 1 }) {
+            auto error = handler.uploadExperimentToChannel(channel, experiment);
+            if (!error)
+                error = handler.startUploadedExperiment(channel);
+            if (error) {
+                qDebug() << "Channel" << channel << ":" << error.message();
+                continue;
+            }
+            ++*running;
+        }
+    });
+
+    auto error = tracker->connectToDeviceOnComPort(COMPORT);
+    if (error) {
+        qDebug() << "Error: " << error.message();
+        return 0;
+    }
+
+    return a.exec();
+}
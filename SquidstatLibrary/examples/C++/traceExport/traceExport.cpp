@@ -0,0 +1,365 @@
+/**
+ * \example traceExport.cpp
+ * This example shows how to record where the time goes in an application that drives several devices, and save it as a
+ * Chrome trace event file that can be opened in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Tracing is opt-in: it is enabled by setting the environment variable SQUIDSTAT_TRACE to the path of the trace file.
+ * When it is not set, `TraceRecorder` records nothing, and the arguments of an event are only built once
+ * TraceRecorder::enabled is checked, so every span costs a single branch and nothing is allocated per sample.
+ *
+ * The trace holds, with the thread and the device and channel of every event:
+ * - a span for building each experiment, for each upload and for the round trip of each command,
+ * - a span for every signal that is handled, so slow handlers and bursts of queued signals show up on the timeline,
+ * - an asynchronous span per channel from the start of the experiment to its stop, with an instant event per element.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisConstantPotElement.h"
+#include "experiments/builder_elements/AisEISPotentiostaticElement.h"
+#include "experiments/builder_elements/AisOpenCircuitElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+/**
+ * Records trace events from any thread and writes them in the Chrome trace event format.
+ */
+class TraceRecorder {
+public:
+    /**
+     * @param path the file to write the trace to. Tracing is disabled if it is empty.
+     * @param maxEvents the number of events to keep at most, so a long run does not use up the memory.
+     */
+    explicit TraceRecorder(const QString& path, size_t maxEvents = 2000000)
+        : m_path(path)
+        , m_maxEvents(maxEvents)
+    {
+        m_clock.start();
+    }
+
+    bool enabled() const { return !m_path.isEmpty(); }
+
+    /**
+     * @brief the time since the recorder was created, in microseconds.
+     */
+    qint64 now() const { return m_clock.nsecsElapsed() / 1000; }
+
+    /**
+     * @brief records a span that began at the given time and ends now.
+     */
+    void complete(const QString& name, const char* category, qint64 begin, const QJsonObject& args = {})
+    {
+        if (!enabled())
+            return;
+        qint64 end = now();
+        QJsonObject event = make(name, category, "X", begin, args);
+        event["dur"] = end - begin;
+        add(event);
+    }
+
+    /**
+     * @brief records a point in time on the calling thread.
+     */
+    void instant(const QString& name, const char* category, const QJsonObject& args = {})
+    {
+        if (!enabled())
+            return;
+        QJsonObject event = make(name, category, "i", now(), args);
+        event["s"] = "t";
+        add(event);
+    }
+
+    /**
+     * @brief begins or ends an asynchronous span, which may end on another thread than the one it began on.
+     * @param id identifies the span; a begin and an end with the same name and id form one span.
+     */
+    void asyncBegin(const QString& name, const char* category, const QString& id, const QJsonObject& args = {})
+    {
+        if (!enabled())
+            return;
+        QJsonObject event = make(name, category, "b", now(), args);
+        event["id"] = id;
+        add(event);
+    }
+
+    void asyncEnd(const QString& name, const char* category, const QString& id, const QJsonObject& args = {})
+    {
+        if (!enabled())
+            return;
+        QJsonObject event = make(name, category, "e", now(), args);
+        event["id"] = id;
+        add(event);
+    }
+
+    /**
+     * @brief gives the calling thread a name in the trace.
+     */
+    void nameThread(const QString& name)
+    {
+        if (!enabled())
+            return;
+        QJsonObject event;
+        event["name"] = "thread_name";
+        event["ph"] = "M";
+        event["pid"] = static_cast<qint64>(QCoreApplication::applicationPid());
+        event["tid"] = threadId();
+        event["args"] = QJsonObject { { "name", name } };
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_events.push_back(event);
+    }
+
+    /**
+     * @brief writes all events recorded so far to the trace file.
+     * @return false if tracing is disabled or the file could not be written.
+     */
+    bool write()
+    {
+        if (!enabled())
+            return false;
+        QJsonArray events;
+        size_t dropped;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const QJsonObject& event : m_events)
+                events.append(event);
+            dropped = m_dropped;
+        }
+
+        QJsonObject trace;
+        trace["traceEvents"] = events;
+        trace["displayTimeUnit"] = "ms";
+        trace["otherData"] = QJsonObject { { "droppedEvents", static_cast<qint64>(dropped) } };
+
+        QSaveFile file(m_path);
+        if (!file.open(QIODevice::WriteOnly))
+            return false;
+        file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+        return file.commit();
+    }
+
+private:
+    QJsonObject make(const QString& name, const char* category, const char* phase, qint64 timestamp, const QJsonObject& args)
+    {
+        QJsonObject event;
+        event["name"] = name;
+        event["cat"] = category;
+        event["ph"] = phase;
+        event["ts"] = timestamp;
+        event["pid"] = static_cast<qint64>(QCoreApplication::applicationPid());
+        event["tid"] = threadId();
+        if (!args.isEmpty())
+            event["args"] = args;
+        return event;
+    }
+
+    void add(const QJsonObject& event)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_events.size() < m_maxEvents)
+            m_events.push_back(event);
+        else
+            ++m_dropped;
+    }
+
+    // small and stable thread ids keep the trace readable
+    qint64 threadId()
+    {
+        std::lock_guard<std::mutex> lock(m_threadMutex);
+        auto inserted = m_threadIds.emplace(std::this_thread::get_id(), static_cast<qint64>(m_threadIds.size() + 1));
+        return inserted.first->second;
+    }
+
+    QString m_path;
+    size_t m_maxEvents;
+    QElapsedTimer m_clock;
+    std::mutex m_mutex;
+    std::vector<QJsonObject> m_events;
+    size_t m_dropped = 0;
+    std::mutex m_threadMutex;
+    std::map<std::thread::id, qint64> m_threadIds;
+};
+
+/**
+ * Records a span from its construction to its destruction, if tracing is enabled.
+ */
+class TraceSpan {
+public:
+    /**
+     * @param makeArgs returns the arguments of the span as a QJsonObject. It is only called if tracing is enabled.
+     */
+    template <typename MakeArgs>
+    TraceSpan(TraceRecorder& recorder, const char* name, const char* category, MakeArgs makeArgs)
+        : m_recorder(recorder)
+        , m_name(name)
+        , m_category(category)
+    {
+        if (!recorder.enabled())
+            return;
+        m_args = makeArgs();
+        m_begin = recorder.now();
+    }
+
+    TraceSpan(TraceRecorder& recorder, const char* name, const char* category)
+        : TraceSpan(recorder, name, category, []() { return QJsonObject(); })
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if (m_recorder.enabled())
+            m_recorder.complete(m_name, m_category, m_begin, m_args);
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    TraceRecorder& m_recorder;
+    const char* m_name;
+    const char* m_category;
+    QJsonObject m_args;
+    qint64 m_begin = 0;
+};
+
+static QJsonObject tags(const QString& deviceName, uint8_t channel)
+{
+    return QJsonObject { { "device", deviceName }, { "channel", channel } };
+}
+
+/**
+ * @brief runs a command inside a span named after it, and adds its result to the span when it fails.
+ */
+template <typename Command>
+AisErrorCode traced(TraceRecorder& recorder, const QString& commandName, const QString& deviceName, uint8_t channel, Command command)
+{
+    qint64 begin = recorder.enabled() ? recorder.now() : 0;
+    AisErrorCode error = command();
+    if (recorder.enabled()) {
+        QJsonObject args = tags(deviceName, channel);
+        if (error)
+            args["error"] = error.message();
+        recorder.complete(commandName, "command", begin, args);
+    }
+    return error;
+}
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    TraceRecorder recorder(qEnvironmentVariable("SQUIDSTAT_TRACE"));
+    recorder.nameThread("event loop");
+    if (!recorder.enabled())
+        qDebug() << "Set SQUIDSTAT_TRACE to a file path to record a trace";
+
+    auto tracker = AisDeviceTracker::Instance();
+    std::set<std::pair<QString, uint8_t>> started;
+
+    auto connectSignals = [&](const QString& deviceName, const AisInstrumentHandler& handler) {
+        QObject::connect(&handler, &AisInstrumentHandler::activeDCDataReady, [&, deviceName](uint8_t channel, const AisDCData& data) {
+            TraceSpan span(recorder, "activeDCDataReady", "signal", [&]() { return tags(deviceName, channel); });
+            qDebug() << deviceName << channel << "Timestamp: " << data.timestamp << " Current: " << data.current << " Voltage: " << data.workingElectrodeVoltage;
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::activeACDataReady, [&, deviceName](uint8_t channel, const AisACData& data) {
+            TraceSpan span(recorder, "activeACDataReady", "signal", [&]() { return tags(deviceName, channel); });
+            qDebug() << deviceName << channel << "Frequency: " << data.frequency << " Modulus: " << data.absoluteImpedance << " Phase: " << data.phaseAngle;
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentNewElementStarting, [&, deviceName](uint8_t channel, const AisExperimentNode& info) {
+            if (!recorder.enabled())
+                return;
+            TraceSpan span(recorder, "experimentNewElementStarting", "signal", [&]() { return tags(deviceName, channel); });
+            QJsonObject args = tags(deviceName, channel);
+            args["step"] = info.stepName;
+            recorder.instant("element " + info.stepName, "experiment", args);
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::deviceError, [&, deviceName](uint8_t channel, const QString& error) {
+            if (!recorder.enabled())
+                return;
+            QJsonObject args = tags(deviceName, channel);
+            args["error"] = error;
+            recorder.instant("deviceError", "signal", args);
+        });
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [&, deviceName](uint8_t channel, const QString& reason) {
+            {
+                TraceSpan span(recorder, "experimentStopped", "signal", [&]() { return tags(deviceName, channel); });
+                if (recorder.enabled()) {
+                    QJsonObject args = tags(deviceName, channel);
+                    args["reason"] = reason;
+                    recorder.asyncEnd("experiment", "experiment", QString("%1/%2").arg(deviceName).arg(channel), args);
+                }
+                qDebug() << deviceName << "Experiment Stopped Signal " << channel << "Reason : " << reason;
+            }
+
+            // write the trace and quit once every experiment this example started has stopped
+            if (started.erase({ deviceName, channel }) == 0)
+                return;
+            if (started.empty()) {
+                if (recorder.enabled())
+                    qDebug() << (recorder.write() ? "Trace written" : "The trace could not be written");
+                QCoreApplication::quit();
+            }
+        });
+    };
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [&](const QString& deviceName) {
+        TraceSpan deviceSpan(recorder, "newDeviceConnected", "signal", [&]() { return QJsonObject { { "device", deviceName } }; });
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        connectSignals(deviceName, handler);
+
+        for (uint8_t channel : handler.getFreeChannels()) {
+            std::shared_ptr<AisExperiment> experiment;
+            {
+                TraceSpan span(recorder, "build experiment", "experiment", [&]() { return tags(deviceName, channel); });
+                AisOpenCircuitElement ocpElement(5, 0.1);
+                AisConstantPotElement cvElement(0.1, 0.01, 10);
+                AisEISPotentiostaticElement eisElement(10000, 1, 10, 0, 0.01);
+                experiment = std::make_shared<AisExperiment>();
+                experiment->appendElement(ocpElement, 1);
+                experiment->appendElement(cvElement, 1);
+                experiment->appendElement(eisElement, 1);
+            }
+
+            auto error = traced(recorder, "uploadExperimentToChannel", deviceName, channel, [&]() { return handler.uploadExperimentToChannel(channel, experiment); });
+            if (!error)
+                error = traced(recorder, "startUploadedExperiment", deviceName, channel, [&]() { return handler.startUploadedExperiment(channel); });
+            if (error) {
+                qDebug() << deviceName << "channel" << channel << ":" << error.message();
+                continue;
+            }
+            if (recorder.enabled())
+                recorder.asyncBegin("experiment", "experiment", QString("%1/%2").arg(deviceName).arg(channel), tags(deviceName, channel));
+            started.insert({ deviceName, channel });
+        }
+    });
+
+    int connected;
+    {
+        TraceSpan span(recorder, "connectAllPluggedInDevices", "command");
+        connected = tracker->connectAllPluggedInDevices();
+    }
+    if (connected == 0) {
+        qDebug() << "No device found";
+        return 0;
+    }
+
+    int result = a.exec();
+    // an interrupted run still leaves a trace behind
+    if (!started.empty())
+        recorder.write();
+    return result;
+}
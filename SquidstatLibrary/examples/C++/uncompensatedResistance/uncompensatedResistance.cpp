@@ -0,0 +1,169 @@
+/**
+ * \example uncompensatedResistance.cpp
+ * This example shows how to measure the uncompensated resistance (Ru) of every free channel and apply it with
+ * AisInstrumentHandler::setIRComp, without any manual step.
+ *
+ * A short high-frequency EIS probe is started on all free channels of every plugged in device at once, so the probes run
+ * in parallel on the instruments. Ru is the real part of the impedance where the imaginary part crosses zero. When the
+ * probe does not reach that crossing, Z' = Ru + a / &omega;<sup>2</sup>, the high-frequency limit of a resistance in
+ * series with an RC element, is fitted to the highest frequencies and extrapolated to infinite frequency. As soon as the
+ * probe of a channel stops, its estimate is applied to that channel.
+ */
+#include "AisDeviceTracker.h"
+#include "AisExperiment.h"
+#include "AisInstrumentHandler.h"
+
+#include "experiments/builder_elements/AisEISPotentiostaticElement.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// the percentage of the estimated Ru to compensate, leaving a margin for stability
+#define COMPENSATION_LEVEL 85
+
+/**
+ * Estimates the uncompensated resistance from the high-frequency part of a spectrum.
+ */
+class UncompensatedResistanceEstimator {
+public:
+    void reset() { m_points.clear(); }
+
+    void addPoint(const AisACData& data)
+    {
+        if (data.frequency > 0)
+            m_points.push_back(data);
+    }
+
+    size_t pointCount() const { return m_points.size(); }
+
+    /**
+     * @brief the estimated uncompensated resistance in ohms.
+     * @return the estimate, or a negative value if there are not enough points to estimate from.
+     */
+    double estimate() const
+    {
+        if (m_points.size() < 2)
+            return -1;
+
+        std::vector<AisACData> points(m_points);
+        std::sort(points.begin(), points.end(), [](const AisACData& a, const AisACData& b) { return a.frequency > b.frequency; });
+
+        // an inductive tail at the highest frequencies: interpolate the real part where the imaginary part crosses zero
+        for (size_t i = 0; i + 1 < points.size(); ++i) {
+            double imag1 = points[i].imagImpedance;
+            double imag2 = points[i + 1].imagImpedance;
+            if (imag1 >= 0 && imag2 < 0)
+                return points[i].realImpedance + (points[i + 1].realImpedance - points[i].realImpedance) * imag1 / (imag1 - imag2);
+        }
+
+        // otherwise extrapolate Z' = Ru + a / omega^2 from the highest frequencies
+        const size_t count = std::min<size_t>(3, points.size());
+        double n = 0, sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+        for (size_t i = 0; i < count; ++i) {
+            double omega = 2 * Pi * points[i].frequency;
+            double x = 1 / (omega * omega);
+            n += 1;
+            sumX += x;
+            sumY += points[i].realImpedance;
+            sumXX += x * x;
+            sumXY += x * points[i].realImpedance;
+        }
+
+        double minimumReal = points.front().realImpedance;
+        for (const AisACData& point : points)
+            minimumReal = std::min(minimumReal, point.realImpedance);
+
+        double denominator = n * sumXX - sumX * sumX;
+        if (std::fabs(denominator) <= 1e-12 * n * sumXX)
+            return minimumReal;
+        double slope = (n * sumXY - sumX * sumY) / denominator;
+        double intercept = (sumY - slope * sumX) / n;
+
+        // a negative slope means the data is not capacitive there, so the extrapolation cannot be trusted
+        if (slope < 0 || intercept < 0 || intercept > minimumReal)
+            return minimumReal;
+        return intercept;
+    }
+
+private:
+    static constexpr double Pi = 3.14159265358979323846;
+
+    std::vector<AisACData> m_points;
+};
+
+int main()
+{
+    char** test = nullptr;
+    int args;
+    QCoreApplication a(args, test);
+
+    auto tracker = AisDeviceTracker::Instance();
+
+    // 100kHz to 1kHz, 10 steps per decade, 10mV around the open circuit potential so the cells stay at rest
+    AisEISPotentiostaticElement probeElement(100000, 1000, 10, 0, 0.01);
+    probeElement.setBiasVoltageVsOCP(true);
+    auto probe = std::make_shared<AisExperiment>();
+    probe->appendElement(probeElement, 1);
+
+    QObject::connect(tracker, &AisDeviceTracker::newDeviceConnected, &a, [=](const QString& deviceName) {
+        auto& handler = tracker->getInstrumentHandler(deviceName);
+        auto estimators = std::make_shared<std::vector<UncompensatedResistanceEstimator>>(std::max(0, handler.getNumberOfChannels()));
+        auto probing = std::make_shared<std::vector<bool>>(estimators->size(), false);
+        auto pending = std::make_shared<int>(0);
+        auto timer = std::make_shared<QElapsedTimer>();
+
+        QObject::connect(&handler, &AisInstrumentHandler::activeACDataReady, [=](uint8_t channel, const AisACData& data) {
+            if (channel < estimators->size())
+                (*estimators)[channel].addPoint(data);
+        });
+
+        QObject::connect(&handler, &AisInstrumentHandler::experimentStopped, [=, &handler](uint8_t channel, const QString& reason) {
+            if (channel >= probing->size() || !(*probing)[channel])
+                return;
+            (*probing)[channel] = false;
+
+            double ru = (*estimators)[channel].estimate();
+            (*estimators)[channel].reset();
+            if (ru < 0) {
+                qDebug() << deviceName << "channel" << channel << ": not enough data to estimate Ru, reason:" << reason;
+            } else {
+                auto error = handler.setIRComp(channel, ru, COMPENSATION_LEVEL);
+                if (error)
+                    qDebug() << deviceName << "channel" << channel << ":" << error.message();
+                else
+                    qDebug() << deviceName << "channel" << channel << ": Ru" << ru << "ohms, compensated at" << COMPENSATION_LEVEL << "%";
+            }
+
+            if (--(*pending) == 0)
+                qDebug() << deviceName << ": all channels probed in" << timer->elapsed() << "ms";
+        });
+
+        // start the probe on every free channel, the channels run it concurrently
+        timer->start();
+        for (uint8_t channel : handler.getFreeChannels()) {
+            auto error = handler.uploadExperimentToChannel(channel, probe);
+            if (!error)
+                error = handler.startUploadedExperiment(channel);
+            if (error) {
+                qDebug() << deviceName << "channel" << channel << ":" << error.message();
+                continue;
+            }
+            if (channel < probing->size()) {
+                (*probing)[channel] = true;
+                ++(*pending);
+            }
+        }
+    });
+
+    if (tracker->connectAllPluggedInDevices() == 0) {
+        qDebug() << "Error: no device found";
+        return 0;
+    }
+
+    return a.exec();
+}